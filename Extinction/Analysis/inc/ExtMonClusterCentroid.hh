@@ -0,0 +1,58 @@
+#ifndef Extinction_Analysis_ExtMonClusterCentroid_hh
+#define Extinction_Analysis_ExtMonClusterCentroid_hh
+//
+// Centroid of an ExtMonFNAL raw cluster in chip pixel units, shared by
+// the Extinction analysis modules so that they place clusters alike.
+//
+// The hits are weighted with their ToT; hits with ToT <= 0 get weight 0.
+// If no hit has a positive ToT the centre of the bounding box of the hits
+// is used.  Hits for which skip(hit) is true, e.g. masked pixels, are left
+// out entirely.
+//
+
+#include <algorithm>
+
+namespace mu2e {
+
+  // Returns false if all hits are skipped.  HITS is a range of pointers
+  // to ExtMonFNALRawHit, e.g. the hits() of an ExtMonFNALRawCluster.
+  template<class HITS, class SKIP>
+  bool clusterCentroid(const HITS& hits, SKIP skip, double& col, double& row) {
+    double sumCol = 0, sumRow = 0, sumW = 0;
+    unsigned colMin = ~0u, colMax = 0, rowMin = ~0u, rowMax = 0;
+    bool any = false;
+    for(const auto& h : hits) {
+      if(skip(*h)) continue;
+      const unsigned c = h->pixelId().col(), r = h->pixelId().row();
+      colMin = std::min(colMin, c);
+      colMax = std::max(colMax, c);
+      rowMin = std::min(rowMin, r);
+      rowMax = std::max(rowMax, r);
+      const double w = (h->tot() > 0) ? h->tot() : 0.;
+      sumCol += w*c;
+      sumRow += w*r;
+      sumW += w;
+      any = true;
+    }
+    if(!any) {
+      return false;
+    }
+    if(sumW > 0.) {
+      col = sumCol/sumW;
+      row = sumRow/sumW;
+    }
+    else {
+      col = 0.5*(colMin + colMax);
+      row = 0.5*(rowMin + rowMax);
+    }
+    return true;
+  }
+
+  template<class HITS>
+  bool clusterCentroid(const HITS& hits, double& col, double& row) {
+    return clusterCentroid(hits, [](const auto&) { return false; }, col, row);
+  }
+
+} // namespace mu2e
+
+#endif/*Extinction_Analysis_ExtMonClusterCentroid_hh*/
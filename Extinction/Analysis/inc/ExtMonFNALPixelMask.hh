@@ -0,0 +1,113 @@
+#ifndef Extinction_Analysis_ExtMonFNALPixelMask_hh
+#define Extinction_Analysis_ExtMonFNALPixelMask_hh
+//
+// Mask of dead or noisy ExtMonFNAL pixels, one bitset per chip.
+//
+// The mask is loaded from maskFile, learned from the pixel occupancy of
+// the first learnEvents events seen by ExtRawHitMasker, or both.  A pixel
+// is learned as noisy when it has more than maxOccupancy hits per event
+// on average; dead pixels do not add hits and only come from the file.
+// The learned mask is written to outputFile, in the maskFile format: one
+// "plane module chipCol chipRow col row" line per masked pixel, with #
+// comments.
+//
+// masked() is a table lookup and a bit test without branches: chips
+// without masked pixels point to a shared all-zero bitset, and pixels
+// outside the chip to an always-zero bit past the end of the bitset.
+//
+// Modules with applyPixelMask skip masked hits, and ExtRawHitMasker
+// writes a masked ExtMonFNALRawHitCollection for downstream jobs.
+// Learning only advances through ExtRawHitMasker: checkLearner() throws
+// for a learning mask in a job without one, and a mask still learning at
+// the end of the job throws too.
+//
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "art/Framework/Services/Registry/ServiceDeclarationMacros.h"
+#include "art/Framework/Services/Registry/ServiceTable.h"
+#include "art/Framework/Services/Registry/ActivityRegistry.h"
+#include "fhiclcpp/types/Atom.h"
+#include "fhiclcpp/types/Table.h"
+
+#include "Offline/RecoDataProducts/inc/ExtMonFNALRawHit.hh"
+
+#include "Extinction/Analysis/inc/ExtMonPixelGeometry.hh"
+#include "Extinction/Analysis/inc/ExtMonPixelKey.hh"
+
+namespace mu2e {
+
+  class ExtMonFNALPixelMask {
+  public:
+    struct Config {
+      using Name=fhicl::Name;
+      using Comment=fhicl::Comment;
+      fhicl::Atom<std::string> maskFile{Name("maskFile"), Comment("Masked pixels to load, \"\" for none"), ""};
+      fhicl::Atom<unsigned long> learnEvents{Name("learnEvents"), Comment("Events to learn noisy pixels from, 0 for no learning"), 0};
+      fhicl::Atom<double> maxOccupancy{Name("maxOccupancy"), Comment("Hits per event above which a pixel is learned as noisy"), 0.01};
+      fhicl::Atom<std::string> outputFile{Name("outputFile"), Comment("Where to write the mask after learning, \"\" for nowhere"), ""};
+      fhicl::Table<ExtMonPixelGeometry::Layout> layout{Name("layout"), Comment("Pixels per chip, see ExtMonPixelGeometry")};
+    };
+    using Parameters = art::ServiceTable<Config>;
+
+    ExtMonFNALPixelMask(const Parameters& conf, art::ActivityRegistry& reg);
+
+    bool masked(const ExtMonFNALPixelId& pix) const {
+      const std::uint64_t* bits = chips_[ExtMonPixelKey::chip(pix.chip())];
+      const std::uint32_t col = pix.col(), row = pix.row();
+      std::uint32_t bit = row*cols_ + col;
+      bit = (col < cols_ && row < rows_) ? bit : bitsPerChip_;
+      return (bits[bit >> 6] >> (bit & 63)) & 1;
+    }
+
+    void mask(const ExtMonFNALPixelId& pix);
+
+    // Counts the hits of one event while learning, false when not learning
+    bool learn(const ExtMonFNALRawHitCollection& hits);
+    bool learning() const { return learnedEvents_ < learnEvents_; }
+
+    // Called by ExtRawHitMasker, which drives the learning
+    void setLearner() { hasLearner_ = true; }
+
+    // Throws if the mask is learning without an ExtRawHitMasker in the job;
+    // for the applyPixelMask modules, from their event method
+    void checkLearner(const std::string& module) const {
+      if(learning() && !hasLearner_) throwNoLearner(module);
+    }
+
+    unsigned long maskedPixels() const { return maskedPixels_; }
+
+    void write(const std::string& fileName) const;
+
+  private:
+    std::uint32_t cols_;
+    std::uint32_t rows_;
+    std::uint32_t bitsPerChip_;
+    std::uint32_t wordsPerChip_; // including the always-zero bit past the end
+
+    std::vector<const std::uint64_t*> chips_;             // by ExtMonPixelKey::chip, 2^chipBits entries
+    std::vector<std::vector<std::uint64_t> > chipBits_;   // owned bitsets, by chip key, empty if unmasked
+    std::vector<std::uint64_t> zeros_;
+
+    unsigned long learnEvents_;
+    unsigned long learnedEvents_;
+    double maxOccupancy_;
+    std::string outputFile_;
+    std::vector<std::vector<std::uint32_t> > counts_;     // hits per pixel while learning, by chip key
+    bool hasLearner_;
+
+    unsigned long maskedPixels_;
+
+    void load(const std::string& fileName);
+    void finishLearning();
+    [[noreturn]] void throwNoLearner(const std::string& module) const;
+    void postEndJob();
+  };
+
+} // namespace mu2e
+
+DECLARE_ART_SERVICE(mu2e::ExtMonFNALPixelMask, LEGACY)
+
+#endif/*Extinction_Analysis_ExtMonFNALPixelMask_hh*/
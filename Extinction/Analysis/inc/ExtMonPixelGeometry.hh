@@ -0,0 +1,107 @@
+#ifndef Extinction_Analysis_ExtMonPixelGeometry_hh
+#define Extinction_Analysis_ExtMonPixelGeometry_hh
+//
+// Pixel layout and positions of the ExtMonFNAL sensors for the
+// Extinction analysis modules.
+//
+// Built from a fhicl Layout it only knows the pixels per chip and chips
+// per module, enough to size per pixel tables (ExtMonPixelMap,
+// ExtMonFNALPixelMask) in jobs without the geometry service.
+//
+// Built from the Offline ExtMonFNAL geometry (GeomHandle<ExtMonFNAL::ExtMon>,
+// from beginRun) it also places the modules and converts between pixels
+// and module local positions:
+//   - pixel() and the local pixel positions go through the geometry's
+//     ExtMonFNALPixelIdConverter, the one the digitization uses, so chip
+//     order and sensor orientation follow the geometry;
+//   - module placements are the plane and module offsets of the plane
+//     stacks, with the module rotation about z and modules on the back of
+//     a plane (negative z offset) turned over, in the frame of the stack
+//     of the plane.  Planes are numbered through the dn stack, then the up
+//     stack.
+// Lookups go through a dense table indexed by the module key of
+// ExtMonPixelKey.
+//
+
+#include <cstdint>
+#include <vector>
+
+#include "fhiclcpp/types/Sequence.h"
+
+#include "CLHEP/Vector/ThreeVector.h"
+
+#include "Offline/DataProducts/inc/ExtMonFNALPixelId.hh"
+
+namespace mu2e {
+
+  namespace ExtMonFNAL { class ExtMon; }
+  class ExtMonFNALPixelIdConverter;
+  class ExtMonFNALPlaneStack;
+
+  class ExtMonPixelGeometry {
+  public:
+
+    struct Layout {
+      using Name=fhicl::Name;
+      using Comment=fhicl::Comment;
+      fhicl::Sequence<unsigned,2> chipPixels{Name("chipPixels"), Comment("[cols, rows] of pixels per chip"), std::vector<unsigned>{80, 336}};
+      fhicl::Sequence<unsigned,2> moduleChips{Name("moduleChips"), Comment("[cols, rows] of chips per module"), std::vector<unsigned>{2, 1}};
+    };
+
+    enum Stack { dn = 0, up = 1 };
+
+    ExtMonPixelGeometry() = default;
+    explicit ExtMonPixelGeometry(const Layout& conf);
+    explicit ExtMonPixelGeometry(const ExtMonFNAL::ExtMon& extmon);
+
+    bool hasModule(const ExtMonFNALModuleId& m) const;
+
+    // Pixel centre in the stack frame; (col, row) may be fractional, e.g.
+    // a cluster centroid, and is interpolated between pixel centres
+    CLHEP::Hep3Vector position(const ExtMonFNALChipId& chip, double col, double row) const;
+
+    CLHEP::Hep3Vector position(const ExtMonFNALPixelId& pix) const {
+      return position(pix.chip(), pix.col(), pix.row());
+    }
+
+    // Pixel at module local (u, v) in mm, false outside the sensor
+    bool pixel(const ExtMonFNALModuleId& m, double u, double v, ExtMonFNALPixelId& pix) const;
+
+    // Pixels per chip and chips per module, [0] along col and [1] along row
+    unsigned chipPixels(unsigned i) const { return chipPixels_[i]; }
+    unsigned moduleChips(unsigned i) const { return moduleChips_[i]; }
+
+    // Pixel pitch, mm, only from the ExtMonFNAL geometry
+    double pitch(unsigned i) const { return pitch_[i]; }
+
+    // Planes of a stack with at least one module, in increasing z
+    const std::vector<unsigned>& planes(Stack stack) const { return planes_[stack]; }
+
+    // Mean z of the modules of the plane in its stack frame
+    double planeZ(unsigned plane) const;
+
+  private:
+    struct Placement {
+      bool present = false;
+      double center[3] = {0., 0., 0.};
+      double u[3] = {1., 0., 0.}; // module local axes in the stack frame
+      double v[3] = {0., 1., 0.};
+    };
+
+    double pitch_[2] = {0., 0.};
+    unsigned chipPixels_[2] = {0, 0};
+    unsigned moduleChips_[2] = {0, 0};
+    const ExtMonFNALPixelIdConverter* converter_ = nullptr;
+    std::vector<Placement> modules_; // by ExtMonPixelKey::module
+    std::vector<unsigned> planes_[2];
+    std::vector<double> planeZ_; // by plane number
+
+    void checkLayout() const;
+    void addStack(const ExtMonFNALPlaneStack& stack, Stack which, unsigned firstPlane);
+    const Placement& placement(const ExtMonFNALModuleId& m) const;
+    const ExtMonFNALPixelIdConverter& converter() const;
+  };
+
+} // namespace mu2e
+
+#endif/*Extinction_Analysis_ExtMonPixelGeometry_hh*/
@@ -0,0 +1,41 @@
+#ifndef Extinction_Analysis_ExtMonPixelKey_hh
+#define Extinction_Analysis_ExtMonPixelKey_hh
+//
+// Dense integer keys for ExtMonFNAL modules and chips, used as radix sort
+// keys and array indices by the Extinction analysis modules.
+//
+// chip key: plane (5 bits) | module (5 bits) | chipCol (3 bits) | chipRow (3 bits)
+// module key: the upper 10 bits of the chip key
+//
+
+#include <cstdint>
+
+#include "Offline/DataProducts/inc/ExtMonFNALPixelId.hh"
+
+namespace mu2e {
+  namespace ExtMonPixelKey {
+
+    constexpr unsigned chipBits = 16;
+
+    inline std::uint32_t module(const ExtMonFNALModuleId& m) {
+      return (std::uint32_t(m.plane()) << 5) | m.number();
+    }
+
+    inline std::uint32_t chip(const ExtMonFNALChipId& c) {
+      return (module(c.module()) << 6) | (std::uint32_t(c.chipCol()) << 3) | c.chipRow();
+    }
+
+    inline unsigned plane(std::uint32_t chipKey) { return chipKey >> 11; }
+    inline unsigned moduleNumber(std::uint32_t chipKey) { return (chipKey >> 6) & 0x1f; }
+    inline unsigned chipCol(std::uint32_t chipKey) { return (chipKey >> 3) & 0x7; }
+    inline unsigned chipRow(std::uint32_t chipKey) { return chipKey & 0x7; }
+
+    inline ExtMonFNALChipId chipId(std::uint32_t chipKey) {
+      return ExtMonFNALChipId(ExtMonFNALModuleId(plane(chipKey), moduleNumber(chipKey)),
+                              chipCol(chipKey), chipRow(chipKey));
+    }
+
+  } // namespace ExtMonPixelKey
+} // namespace mu2e
+
+#endif/*Extinction_Analysis_ExtMonPixelKey_hh*/
@@ -0,0 +1,50 @@
+#ifndef Extinction_Analysis_ExtMonPixelMap_hh
+#define Extinction_Analysis_ExtMonPixelMap_hh
+//
+// In-job per pixel sums over the ExtMonFNAL modules, e.g. hit counts or
+// deposited energy, for occupancy maps without a per hit ntuple.
+//
+// Each module gets a dense (col, row) array of the module pixels, the
+// chips laid out as in ExtMonPixelGeometry, allocated on its first fill
+// and found through a table indexed by the ExtMonPixelKey module key.
+// Memory is bounded by the modules hit, not by the number of events.
+//
+// write() stores one TH2D <name>_module<M> per module in a plane<P>
+// subdirectory, col along x and row along y; the maps of jobs with the
+// same layout merge with hadd.
+//
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Offline/DataProducts/inc/ExtMonFNALPixelId.hh"
+
+namespace art { class TFileDirectory; }
+
+namespace mu2e {
+
+  class ExtMonPixelGeometry;
+
+  class ExtMonPixelMap {
+  public:
+    explicit ExtMonPixelMap(const ExtMonPixelGeometry& layout);
+
+    void fill(const ExtMonFNALPixelId& pix, double weight = 1.);
+
+    void write(art::TFileDirectory& dir, const std::string& name, const std::string& title) const;
+
+    unsigned long entries() const { return entries_; }
+
+  private:
+    unsigned chipPixels_[2];
+    unsigned cols_;
+    unsigned rows_;
+    std::vector<std::vector<double> > modules_; // by ExtMonPixelKey::module, empty if not hit
+    std::vector<unsigned long> moduleEntries_;
+    unsigned long entries_ = 0;
+  };
+
+} // namespace mu2e
+
+#endif/*Extinction_Analysis_ExtMonPixelMap_hh*/
@@ -0,0 +1,158 @@
+#ifndef Extinction_Analysis_ExtRawHitStream_hh
+#define Extinction_Analysis_ExtRawHitStream_hh
+//
+// Compact binary stream of ExtMonFNAL raw hits, one 64 bit word per hit,
+// written by ExtRawHitDumper with output "packed" or "both".
+//
+// Hit word, from the most significant bit:
+//   plane (5) | module (5) | chipCol (3) | chipRow (3)  -- the ExtMonPixelKey chip key
+//   col (10) | row (10) | clock + 2^19 (20) | tot (8)
+// so sorting the words sorts the hits by chip, pixel and clock.
+//
+// File layout, native (little endian) byte order, all offsets in bytes:
+//   Header (64 bytes)
+//   hit words of all events, event after event
+//   Event index, one EventEntry (24 bytes) per event
+// The header is rewritten with the final counts on close, a file with
+// numEvents == 0 and a non-zero size was not closed properly.
+//
+// Reader maps the file read-only, so a job can walk the index and decode
+// only the events it needs.  It checks on opening that every index entry
+// lies within the hit words, and event(), words() and decode() throw for
+// an event number past the end.  The stream code depends only on
+// cetlib_except, so it also builds into standalone programs.
+//
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace mu2e {
+  namespace ExtRawHitStream {
+
+    constexpr char magic[8] = {'E', 'M', 'F', 'R', 'A', 'W', 'H', '1'};
+    constexpr std::uint32_t version = 1;
+    constexpr std::int32_t clockBias = 1 << 19;
+
+    struct Header {
+      char magic[8];
+      std::uint32_t version;
+      std::uint32_t headerSize;
+      std::uint64_t numEvents;
+      std::uint64_t numHits;
+      std::uint64_t indexOffset;
+      std::uint64_t reserved[3];
+    };
+    static_assert(sizeof(Header) == 64, "ExtRawHitStream::Header must be 64 bytes");
+
+    struct EventEntry {
+      std::uint32_t run;
+      std::uint32_t subRun;
+      std::uint32_t event;
+      std::uint32_t numHits;
+      std::uint64_t firstHit; // index of the first hit word of the event
+    };
+    static_assert(sizeof(EventEntry) == 24, "ExtRawHitStream::EventEntry must be 24 bytes");
+
+    struct Hit {
+      unsigned plane;
+      unsigned module;
+      unsigned chipCol;
+      unsigned chipRow;
+      unsigned col;
+      unsigned row;
+      int clock;
+      unsigned tot;
+    };
+
+    // False if a field does not fit its bits
+    inline bool pack(const Hit& h, std::uint64_t& word) {
+      const std::int64_t clock = std::int64_t(h.clock) + clockBias;
+      if(h.plane >= 32 || h.module >= 32 || h.chipCol >= 8 || h.chipRow >= 8 ||
+         h.col >= 1024 || h.row >= 1024 || clock < 0 || clock >= (1 << 20) || h.tot >= 256) {
+        return false;
+      }
+      word = (std::uint64_t(h.plane) << 59) | (std::uint64_t(h.module) << 54)
+        | (std::uint64_t(h.chipCol) << 51) | (std::uint64_t(h.chipRow) << 48)
+        | (std::uint64_t(h.col) << 38) | (std::uint64_t(h.row) << 28)
+        | (std::uint64_t(clock) << 8) | h.tot;
+      return true;
+    }
+
+    inline int clock(std::uint64_t word) {
+      return int((word >> 8) & 0xfffff) - clockBias;
+    }
+
+    inline Hit unpack(std::uint64_t word) {
+      Hit h;
+      h.plane = word >> 59;
+      h.module = (word >> 54) & 0x1f;
+      h.chipCol = (word >> 51) & 0x7;
+      h.chipRow = (word >> 48) & 0x7;
+      h.col = (word >> 38) & 0x3ff;
+      h.row = (word >> 28) & 0x3ff;
+      h.clock = clock(word);
+      h.tot = word & 0xff;
+      return h;
+    }
+
+    //================================================================
+    class Writer {
+    public:
+      explicit Writer(const std::string& fileName);
+      ~Writer();
+
+      Writer(const Writer&) = delete;
+      Writer& operator=(const Writer&) = delete;
+
+      void add(std::uint32_t run, std::uint32_t subRun, std::uint32_t event,
+               const std::vector<std::uint64_t>& words);
+
+      // Writes the index and the final header, called by the destructor if needed
+      void close();
+
+      std::uint64_t numEvents() const { return index_.size(); }
+      std::uint64_t numHits() const { return numHits_; }
+
+    private:
+      std::string fileName_;
+      std::FILE* file_;
+      std::vector<EventEntry> index_;
+      std::uint64_t numHits_;
+    };
+
+    //================================================================
+    class Reader {
+    public:
+      explicit Reader(const std::string& fileName);
+      ~Reader();
+
+      Reader(const Reader&) = delete;
+      Reader& operator=(const Reader&) = delete;
+
+      std::uint64_t numEvents() const { return header_->numEvents; }
+      std::uint64_t numHits() const { return header_->numHits; }
+
+      const EventEntry& event(std::uint64_t i) const;
+
+      // Hit words of event i, event(i).numHits of them
+      const std::uint64_t* words(std::uint64_t i) const { return words_ + event(i).firstHit; }
+
+      // Appends the decoded hits of event i to hits
+      void decode(std::uint64_t i, std::vector<Hit>& hits) const;
+
+    private:
+      std::string fileName_;
+      void* data_;
+      std::size_t size_;
+      const Header* header_;
+      const std::uint64_t* words_;
+      const EventEntry* index_;
+    };
+
+  } // namespace ExtRawHitStream
+} // namespace mu2e
+
+#endif/*Extinction_Analysis_ExtRawHitStream_hh*/
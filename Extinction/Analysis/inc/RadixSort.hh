@@ -0,0 +1,79 @@
+#ifndef Extinction_Analysis_RadixSort_hh
+#define Extinction_Analysis_RadixSort_hh
+//
+// Stable LSD radix sort of a permutation by 64 bit keys, one byte per
+// pass.  Bytes that are equal in all keys are skipped, so keys packing a
+// chip index above a clock value cost two or three passes over the data
+// whatever the hit count.  Equal keys keep their input order.
+//
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace mu2e {
+
+  // On return order[0..n) holds the indices into keys[0..n) in increasing
+  // key order.  buffer is n entries of scratch space, so callers can keep
+  // both arrays in their own storage, e.g. a per event arena.
+  inline void radixSortIndices(const std::uint64_t* keys, std::size_t n, std::uint32_t* order, std::uint32_t* buffer) {
+    for(std::size_t i = 0; i < n; ++i) {
+      order[i] = i;
+    }
+    if(n < 2) {
+      return;
+    }
+
+    std::uint64_t allOr = 0, allAnd = ~std::uint64_t(0);
+    for(std::size_t i = 0; i < n; ++i) {
+      allOr |= keys[i];
+      allAnd &= keys[i];
+    }
+    const std::uint64_t varying = allOr ^ allAnd;
+
+    std::uint32_t* src = order;
+    std::uint32_t* dst = buffer;
+    std::uint32_t count[256];
+    for(unsigned shift = 0; shift < 64; shift += 8) {
+      if(((varying >> shift) & 0xff) == 0) {
+        continue;
+      }
+      for(unsigned b = 0; b < 256; ++b) {
+        count[b] = 0;
+      }
+      for(std::size_t i = 0; i < n; ++i) {
+        ++count[(keys[src[i]] >> shift) & 0xff];
+      }
+      std::uint32_t sum = 0;
+      for(unsigned b = 0; b < 256; ++b) {
+        const std::uint32_t c = count[b];
+        count[b] = sum;
+        sum += c;
+      }
+      for(std::size_t i = 0; i < n; ++i) {
+        dst[count[(keys[src[i]] >> shift) & 0xff]++] = src[i];
+      }
+      std::swap(src, dst);
+    }
+    if(src != order) {
+      std::copy(src, src + n, order);
+    }
+  }
+
+  // On return order[i] is the index into keys of the i-th smallest key
+  inline void radixSortIndices(const std::vector<std::uint64_t>& keys, std::vector<std::uint32_t>& order) {
+    std::vector<std::uint32_t> buffer(keys.size());
+    order.resize(keys.size());
+    radixSortIndices(keys.data(), keys.size(), order.data(), buffer.data());
+  }
+
+  // Order preserving map of a signed value, e.g. a clock, to an unsigned key field
+  inline std::uint32_t radixKey(std::int32_t v) {
+    return std::uint32_t(v) ^ 0x80000000u;
+  }
+
+} // namespace mu2e
+
+#endif/*Extinction_Analysis_RadixSort_hh*/
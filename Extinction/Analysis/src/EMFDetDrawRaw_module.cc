@@ -1,6 +1,12 @@
 // An EDAnalyzer template to print out a data collection
 //
 // Andrei Gaponenko, 2012
+//
+// mode "ntuple" (default) writes one row per hit, "accumulate" instead
+// sums the hits per pixel of each module and writes them as TH2Ds at
+// endJob, "both" does both.  The pixel layout is taken from the optional
+// "layout" table, see ExtMonPixelGeometry::Layout.  With applyPixelMask
+// the hits masked by ExtMonFNALPixelMask are left out.
 
 #ifndef ExtinctionMonitorFNAL_Analyses_EMFDetDrawRaw_hh
 #define ExtinctionMonitorFNAL_Analyses_EMFDetDrawRaw_hh
@@ -14,12 +20,17 @@
 #include "art/Framework/Core/EDAnalyzer.h"
 #include "fhiclcpp/types/Atom.h" 
 #include "fhiclcpp/types/OptionalSequence.h"
+#include "fhiclcpp/types/Table.h"
 #include "art/Framework/Principal/Event.h"
 #include "art/Framework/Principal/Run.h"
 #include "art/Framework/Principal/Provenance.h"
 #include "art_root_io/TFileService.h"
+#include "art_root_io/TFileDirectory.h"
+#include "cetlib_except/exception.h"
 
 #include <iostream>
+#include <set>
+#include <string>
 
 #include "fhiclcpp/ParameterSet.h"
 #include "art/Framework/Core/EDAnalyzer.h"
@@ -27,6 +38,10 @@
 
 #include "Offline/RecoDataProducts/inc/ExtMonFNALRawHit.hh"
 
+#include "Extinction/Analysis/inc/ExtMonFNALPixelMask.hh"
+#include "Extinction/Analysis/inc/ExtMonPixelGeometry.hh"
+#include "Extinction/Analysis/inc/ExtMonPixelMap.hh"
+
 
 namespace mu2e {
 
@@ -70,13 +85,20 @@ namespace mu2e {
     std::string _inInstanceName;
 
 
+    bool ntuple_;
+    bool accumulate_;
+    const ExtMonFNALPixelMask* mask_;
     TTree *nt_;
     ExtRawHit hit_;
 
+    ExtMonPixelGeometry layout_;
+    ExtMonPixelMap hitMap_;
+
   public:
     explicit EMFDetDrawRaw(const fhicl::ParameterSet& pset);
     virtual void beginJob();    
     virtual void analyze(const art::Event& event);
+    virtual void endJob();
   };
 
   //================================================================
@@ -84,12 +106,27 @@ namespace mu2e {
     : art::EDAnalyzer(pset)
     , _inModuleLabel(pset.get<std::string>("inputModuleLabel"))
     , _inInstanceName(pset.get<std::string>("inputInstanceName"))
+    , ntuple_(true)
+    , accumulate_(false)
+    , mask_(pset.get<bool>("applyPixelMask", false) ? &*art::ServiceHandle<ExtMonFNALPixelMask>() : nullptr)
     , nt_(0)
-  {}
+    , layout_(fhicl::Table<ExtMonPixelGeometry::Layout>(pset.get<fhicl::ParameterSet>("layout", fhicl::ParameterSet()),
+                                                        std::set<std::string>())())
+    , hitMap_(layout_)
+  {
+    const std::string mode = pset.get<std::string>("mode", "ntuple");
+    if(mode != "ntuple" && mode != "accumulate" && mode != "both") {
+      throw cet::exception("BADCONFIG")<<"EMFDetDrawRaw: unknown mode \""<<mode<<"\", expect ntuple, accumulate or both\n";
+    }
+    ntuple_ = (mode != "accumulate");
+    accumulate_ = (mode != "ntuple");
+  }
 
 
   void EMFDetDrawRaw::beginJob() {
 
+    if(!ntuple_) return;
+
     art::ServiceHandle<art::TFileService> tfs;
     static const char branchDesc[] = "RunID/I:SubRunID/I:EventID/L:planeId/i:moduleId/i:chipCol/i:chipRow/i:Col/i:Row/i:clock/I:tot/i"; 
     nt_ = tfs->make<TTree>( "nt", "ExtRawHits ntuple");
@@ -100,6 +137,8 @@ namespace mu2e {
   //================================================================
   void EMFDetDrawRaw::analyze(const art::Event& event) {
 
+    if(mask_) mask_->checkLearner("EMFDetDrawRaw");
+
     art::Handle<ExtMonFNALRawHitCollection> ih;
     event.getByLabel(_inModuleLabel, _inInstanceName, ih);
 
@@ -116,12 +155,30 @@ namespace mu2e {
      //	      <<", "<<i->pixelId().col()<<", "<<i->pixelId().row()<<") "
      //       <<"clock = "<<i->clock()<<",  "<<"tot = "<<i->tot()<<std::endl;
 
-      hit_ = ExtRawHit(event.run(), event.subRun(), event.event(), *i);
+      if(mask_ && mask_->masked(i->pixelId())) continue;
+
+      if(ntuple_) {
+        hit_ = ExtRawHit(event.run(), event.subRun(), event.event(), *i);
 
-      nt_->Fill();
+        nt_->Fill();
+      }
+
+      if(accumulate_) {
+        hitMap_.fill(i->pixelId());
+      }
     }
   }
 
+  //================================================================
+  void EMFDetDrawRaw::endJob() {
+
+    if(!accumulate_) return;
+
+    art::ServiceHandle<art::TFileService> tfs;
+    art::TFileDirectory hd = tfs->mkdir("occupancy");
+    hitMap_.write(hd, "rawHits", "Raw hits");
+  }
+
   //================================================================
 } // namespace mu2e
 
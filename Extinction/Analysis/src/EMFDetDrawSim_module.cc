@@ -1,6 +1,13 @@
 // An EDAnalyzer template to print out a data collection
 //
 // Andrei Gaponenko, 2012
+//
+// mode "ntuple" (default) writes one row per hit, "accumulate" instead
+// sums the hits and their deposited energy per pixel of each module, at
+// the pixel under the middle of the hit, and writes them as TH2Ds at
+// endJob, "both" does both.  The pixels and the map layout come from the
+// ExtMonFNAL geometry at beginRun, through its pixel-ID converter as in
+// the digitization.
 
 #ifndef ExtinctionMonitorFNAL_Analyses_EMFDetDrawSim_hh
 #define ExtinctionMonitorFNAL_Analyses_EMFDetDrawSim_hh
@@ -18,15 +25,24 @@
 #include "art/Framework/Principal/Run.h"
 #include "art/Framework/Principal/Provenance.h"
 #include "art_root_io/TFileService.h"
+#include "art_root_io/TFileDirectory.h"
+#include "cetlib_except/exception.h"
 
 #include <iostream>
+#include <memory>
+#include <string>
 
 #include "fhiclcpp/ParameterSet.h"
 #include "art/Framework/Core/EDAnalyzer.h"
 #include "art/Framework/Principal/Event.h"
 
+#include "Offline/GeometryService/inc/GeomHandle.hh"
+#include "Offline/ExtinctionMonitorFNAL/Geometry/inc/ExtMonFNAL.hh"
 #include "Offline/MCDataProducts/inc/ExtMonFNALSimHit.hh"
 
+#include "Extinction/Analysis/inc/ExtMonPixelGeometry.hh"
+#include "Extinction/Analysis/inc/ExtMonPixelMap.hh"
+
 
 namespace mu2e {
 
@@ -79,13 +95,21 @@ namespace mu2e {
     std::string _inInstanceName;
 
 
+    bool ntuple_;
+    bool accumulate_;
     TTree *nt_;
     ExtSimHit hit_;
 
+    ExtMonPixelGeometry geom_;      // from the ExtMonFNAL geometry at beginRun, accumulate only
+    std::unique_ptr<ExtMonPixelMap> hitMap_;
+    std::unique_ptr<ExtMonPixelMap> energyMap_;
+
   public:
     explicit EMFDetDrawSim(const fhicl::ParameterSet& pset);
     virtual void beginJob();    
+    virtual void beginRun(const art::Run& run);
     virtual void analyze(const art::Event& event);
+    virtual void endJob();
   };
 
   //================================================================
@@ -93,13 +117,23 @@ namespace mu2e {
     : art::EDAnalyzer(pset)
     , _inModuleLabel(pset.get<std::string>("inputModuleLabel"))
     , _inInstanceName(pset.get<std::string>("inputInstanceName"))
+    , ntuple_(true)
+    , accumulate_(false)
     , nt_(0)
-    
-  {}
+  {
+    const std::string mode = pset.get<std::string>("mode", "ntuple");
+    if(mode != "ntuple" && mode != "accumulate" && mode != "both") {
+      throw cet::exception("BADCONFIG")<<"EMFDetDrawSim: unknown mode \""<<mode<<"\", expect ntuple, accumulate or both\n";
+    }
+    ntuple_ = (mode != "accumulate");
+    accumulate_ = (mode != "ntuple");
+  }
 
 
   void EMFDetDrawSim::beginJob() {
 
+    if(!ntuple_) return;
+
     art::ServiceHandle<art::TFileService> tfs;
     static const char branchDesc[] = "RunID/I:SubRunID/I:EventID/L:planeId/i:moduleId/i:eTot/D:eIon/D:startX/D:startY/D:startZ/D:startT/D:endX/D:endY/D:endZ/D:endT/D:partilceId/i";
     nt_ = tfs->make<TTree>( "nt", "ExtSimHits ntuple");
@@ -107,6 +141,19 @@ namespace mu2e {
 
   }	  
 
+  //================================================================
+  void EMFDetDrawSim::beginRun(const art::Run&) {
+
+    if(!accumulate_) return;
+
+    GeomHandle<ExtMonFNAL::ExtMon> extmon;
+    geom_ = ExtMonPixelGeometry(*extmon);
+    if(!hitMap_) {
+      hitMap_.reset(new ExtMonPixelMap(geom_));
+      energyMap_.reset(new ExtMonPixelMap(geom_));
+    }
+  }
+
   //================================================================
   void EMFDetDrawSim::analyze(const art::Event& event) {
 
@@ -125,11 +172,34 @@ namespace mu2e {
       //        <<", end : ("<<i->localEndPosition().x()<<", "<<i->localEndPosition().y()<<", "<<i->localEndPosition().z()<<", t = "<<i->endTime()<<") "	      
       //	<<std::endl;
 	    
-      hit_ = ExtSimHit(event.run(), event.subRun(), event.event(), *i);
-      nt_->Fill();
+      if(ntuple_) {
+        hit_ = ExtSimHit(event.run(), event.subRun(), event.event(), *i);
+        nt_->Fill();
+      }
+
+      if(accumulate_) {
+        ExtMonFNALPixelId pix;
+        const CLHEP::Hep3Vector mid = 0.5*(i->localStartPosition() + i->localEndPosition());
+        if(geom_.pixel(i->moduleId(), mid.x(), mid.y(), pix)) {
+          hitMap_->fill(pix);
+          energyMap_->fill(pix, i->totalEnergyDeposit());
+        }
+      }
     }
   }
 
+  //================================================================
+  void EMFDetDrawSim::endJob() {
+
+    if(!accumulate_ || !hitMap_) return;
+
+    art::ServiceHandle<art::TFileService> tfs;
+    art::TFileDirectory hd = tfs->mkdir("occupancy");
+    hitMap_->write(hd, "simHits", "Sim hits");
+    art::TFileDirectory ed = tfs->mkdir("energy");
+    energyMap_->write(ed, "simEnergy", "Sim hit energy deposit, MeV");
+  }
+
   //================================================================
 } // namespace mu2e
 
@@ -0,0 +1,291 @@
+// Streaming estimate of the extinction, the ratio of out-of-time to
+// in-time hits, from ExtMonFNALRawHit clocks.
+//
+// Hits are counted per clock over clockRange.  A hit is in time if its
+// clock is inside the inTime window and out of time if it is inside any of
+// the outOfTime windows (inclusive clock ranges), other hits are only
+// counted per clock.  The interval on the ratio is either
+//   "poisson":   Clopper-Pearson on the out-of-time fraction given the
+//                total count, mapped to the ratio; or
+//   "bootstrap": percentiles of the ratio over bootstrapSamples Poisson
+//                bootstrap replicas, reweighting whole events, which also
+//                covers event to event fluctuations of the beam.  The
+//                replica weights come from an engine of the SeedService.
+// Both only keep counters, no per-hit or per-event rows are stored.
+//
+// At endJob the per-clock counts are written to the "hitClock" histogram
+// and the result to the one row "summary" tree and the log.  With
+// reportEvery the running ratio is logged every that many events.
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <sstream>
+
+#include "cetlib_except/exception.h"
+
+#include "CLHEP/Random/RandPoissonQ.h"
+
+#include "TEfficiency.h"
+#include "TH1D.h"
+#include "TTree.h"
+
+#include "canvas/Utilities/InputTag.h"
+#include "art/Framework/Core/EDAnalyzer.h"
+#include "fhiclcpp/types/Atom.h"
+#include "fhiclcpp/types/Sequence.h"
+#include "art/Framework/Principal/Event.h"
+#include "art/Framework/Principal/Handle.h"
+#include "art/Framework/Services/Registry/ServiceHandle.h"
+#include "art_root_io/TFileService.h"
+#include "messagefacility/MessageLogger/MessageLogger.h"
+
+#include "Offline/SeedService/inc/SeedService.hh"
+#include "Offline/RecoDataProducts/inc/ExtMonFNALRawHit.hh"
+
+
+namespace mu2e {
+
+  //================================================================
+
+  struct ExtExtinctionSummary {
+
+          unsigned long long nEvents;
+          unsigned long long nInTime;
+          unsigned long long nOutOfTime;
+          unsigned long long nOther;
+          double ratio;
+          double low;
+          double high;
+          double confidenceLevel;
+
+    ExtExtinctionSummary() :  nEvents(0), nInTime(0), nOutOfTime(0), nOther(0),
+                              ratio(0), low(0), high(0), confidenceLevel(0)
+                {}
+
+  }; // struct ExtExtinctionSummary
+
+  //================================================================
+  class ExtExtinctionRatio : public art::EDAnalyzer {
+    struct Config {
+      using Name=fhicl::Name;
+      using Comment=fhicl::Comment;
+      fhicl::Atom<std::string> hits     {Name("hitsInputTag"     ), Comment("ExtMonFNALRawHit collection")};
+      fhicl::Sequence<int,2> inTime{Name("inTime"), Comment("[first, last] clock of the in-time window")};
+      fhicl::Sequence<fhicl::Sequence<int,2> > outOfTime{Name("outOfTime"),
+          Comment("[first, last] clocks of the out-of-time windows")};
+      fhicl::Sequence<int,2> clockRange{Name("clockRange"), Comment("[first, last] clock of the per-clock counters"),
+          std::array<int,2>{0, 4095}};
+      fhicl::Atom<std::string> interval{Name("interval"), Comment("\"poisson\" or \"bootstrap\""), "poisson"};
+      fhicl::Atom<double> confidenceLevel{Name("confidenceLevel"), Comment("Coverage of the interval"), 0.6827};
+      fhicl::Atom<unsigned> bootstrapSamples{Name("bootstrapSamples"), Comment("Replicas of the bootstrap interval"), 1000};
+      fhicl::Atom<unsigned> reportEvery{Name("reportEvery"), Comment("Log the running ratio every that many events, 0 for never"), 0};
+    };
+
+    typedef art::EDAnalyzer::Table<Config> Parameters;
+
+    enum class Window : unsigned char { Other, InTime, OutOfTime };
+
+  protected:
+
+    art::InputTag hitsInputTag_;
+    int clockMin_;
+    int clockMax_;
+    bool bootstrap_;
+    double confidenceLevel_;
+    unsigned reportEvery_;
+
+    std::vector<Window> window_;             // per clock in clockRange
+    std::array<int,2> inTime_;
+    std::vector<std::array<int,2> > outOfTime_;
+    std::vector<unsigned long long> perClock_;
+    unsigned long long underflow_;
+    unsigned long long overflow_;
+
+    ExtExtinctionSummary summary_;
+
+    // Poisson bootstrap replicas: weighted in-time and out-of-time counts,
+    // the weights are only drawn, and the engine only made, for "bootstrap"
+    std::unique_ptr<CLHEP::RandPoissonQ> weight_;
+    std::vector<double> replicaIn_;
+    std::vector<double> replicaOut_;
+
+    Window classify(int clock) const;
+    void interval(double& ratio, double& low, double& high) const;
+
+    public:
+    explicit ExtExtinctionRatio(const Parameters& pset);
+    virtual void analyze(const art::Event& event);
+    virtual void endJob();
+  };
+
+  //================================================================
+  ExtExtinctionRatio::ExtExtinctionRatio(const Parameters& pset)
+    : art::EDAnalyzer(pset)
+      , hitsInputTag_(pset().hits())
+      , clockMin_(pset().clockRange()[0])
+      , clockMax_(pset().clockRange()[1])
+      , bootstrap_(pset().interval() == "bootstrap")
+      , confidenceLevel_(pset().confidenceLevel())
+      , reportEvery_(pset().reportEvery())
+      , inTime_(pset().inTime())
+      , underflow_(0)
+      , overflow_(0)
+  {
+    if(pset().interval() != "poisson" && pset().interval() != "bootstrap") {
+      throw cet::exception("BADCONFIG")<<"ExtExtinctionRatio: unknown interval \""<<pset().interval()
+                                       <<"\", expect poisson or bootstrap\n";
+    }
+    if(bootstrap_ && pset().bootstrapSamples() == 0) {
+      throw cet::exception("BADCONFIG")<<"ExtExtinctionRatio: bootstrapSamples must be positive for the bootstrap interval\n";
+    }
+    if(!(confidenceLevel_ > 0. && confidenceLevel_ < 1.)) {
+      throw cet::exception("BADCONFIG")<<"ExtExtinctionRatio: confidenceLevel must be in (0, 1)\n";
+    }
+    if(clockMax_ < clockMin_ || inTime_[1] < inTime_[0]) {
+      throw cet::exception("BADCONFIG")<<"ExtExtinctionRatio: empty clockRange or inTime window\n";
+    }
+    for(const auto& w : pset().outOfTime()) {
+      if(w[1] < w[0] || (w[0] <= inTime_[1] && inTime_[0] <= w[1])) {
+        throw cet::exception("BADCONFIG")<<"ExtExtinctionRatio: out-of-time window ["<<w[0]<<", "<<w[1]
+                                         <<"] is empty or overlaps the in-time window\n";
+      }
+      outOfTime_.push_back(w);
+    }
+    if(outOfTime_.empty()) {
+      throw cet::exception("BADCONFIG")<<"ExtExtinctionRatio: no out-of-time window\n";
+    }
+
+    // Windows outside clockRange are still classified, through classify()
+    perClock_.assign(clockMax_ - clockMin_ + 1, 0);
+    window_.resize(perClock_.size());
+    for(int c = clockMin_; c <= clockMax_; ++c) {
+      window_[c - clockMin_] = classify(c);
+    }
+
+    if(bootstrap_) {
+      weight_ = std::make_unique<CLHEP::RandPoissonQ>(createEngine(art::ServiceHandle<SeedService>()->getSeed()), 1.0);
+      replicaIn_.assign(pset().bootstrapSamples(), 0.);
+      replicaOut_.assign(pset().bootstrapSamples(), 0.);
+    }
+  }
+
+  //================================================================
+  ExtExtinctionRatio::Window ExtExtinctionRatio::classify(int clock) const {
+    if(inTime_[0] <= clock && clock <= inTime_[1]) return Window::InTime;
+    for(const auto& w : outOfTime_) {
+      if(w[0] <= clock && clock <= w[1]) return Window::OutOfTime;
+    }
+    return Window::Other;
+  }
+
+  //================================================================
+  void ExtExtinctionRatio::interval(double& ratio, double& low, double& high) const {
+    const double nIn = summary_.nInTime, nOut = summary_.nOutOfTime;
+    ratio = (nIn > 0) ? nOut/nIn : std::numeric_limits<double>::infinity();
+
+    if(!bootstrap_) {
+      // Out-of-time fraction rho = r/(1 + r) is binomial given the total
+      const double total = nIn + nOut;
+      const double rhoLow = TEfficiency::ClopperPearson(total, nOut, confidenceLevel_, false);
+      const double rhoHigh = TEfficiency::ClopperPearson(total, nOut, confidenceLevel_, true);
+      low = rhoLow/(1. - rhoLow);
+      high = (rhoHigh < 1.) ? rhoHigh/(1. - rhoHigh) : std::numeric_limits<double>::infinity();
+      return;
+    }
+
+    std::vector<double> r(replicaIn_.size());
+    for(std::size_t b = 0; b < r.size(); ++b) {
+      r[b] = (replicaIn_[b] > 0) ? replicaOut_[b]/replicaIn_[b] : std::numeric_limits<double>::infinity();
+    }
+    std::sort(r.begin(), r.end());
+    const double alpha = 0.5*(1. - confidenceLevel_);
+    const std::size_t n = r.size();
+    low = n ? r[std::min(n - 1, std::size_t(alpha*n))] : 0.;
+    high = n ? r[std::min(n - 1, std::size_t((1. - alpha)*n))] : 0.;
+  }
+
+  //================================================================
+
+  void ExtExtinctionRatio::analyze(const art::Event& event) {
+
+    const auto& ih = event.getValidHandle<ExtMonFNALRawHitCollection>(hitsInputTag_);
+
+    unsigned long long nIn = 0, nOut = 0, nOther = 0;
+    for(const auto& hit : *ih) {
+      const int clock = hit.clock();
+      Window w;
+      if(clock < clockMin_) { ++underflow_; w = classify(clock); }
+      else if(clock > clockMax_) { ++overflow_; w = classify(clock); }
+      else {
+        ++perClock_[clock - clockMin_];
+        w = window_[clock - clockMin_];
+      }
+      nIn += (w == Window::InTime);
+      nOut += (w == Window::OutOfTime);
+      nOther += (w == Window::Other);
+    }
+
+    ++summary_.nEvents;
+    summary_.nInTime += nIn;
+    summary_.nOutOfTime += nOut;
+    summary_.nOther += nOther;
+
+    if(nIn + nOut > 0) {
+      for(std::size_t b = 0; b < replicaIn_.size(); ++b) {
+        const long k = weight_->fire();
+        replicaIn_[b] += k*double(nIn);
+        replicaOut_[b] += k*double(nOut);
+      }
+    }
+    else {
+      // The replica weights do not matter for empty events, keep the stream aligned
+      for(std::size_t b = 0; b < replicaIn_.size(); ++b) weight_->fire();
+    }
+
+    if(reportEvery_ > 0 && summary_.nEvents % reportEvery_ == 0) {
+      double ratio, low, high;
+      interval(ratio, low, high);
+      mf::LogInfo("Info")<<"ExtExtinctionRatio: after "<<summary_.nEvents<<" events "
+                         <<summary_.nOutOfTime<<"/"<<summary_.nInTime<<" = "<<ratio
+                         <<" ["<<low<<", "<<high<<"]";
+    }
+  }
+
+  //================================================================
+
+  void ExtExtinctionRatio::endJob() {
+    interval(summary_.ratio, summary_.low, summary_.high);
+    summary_.confidenceLevel = confidenceLevel_;
+
+    art::ServiceHandle<art::TFileService> tfs;
+    TH1D* h = tfs->make<TH1D>("hitClock", "Hits per clock;clock;hits",
+                              clockMax_ - clockMin_ + 1, clockMin_ - 0.5, clockMax_ + 0.5);
+    for(std::size_t i = 0; i < perClock_.size(); ++i) {
+      h->SetBinContent(i + 1, perClock_[i]);
+    }
+    h->SetBinContent(0, underflow_);
+    h->SetBinContent(perClock_.size() + 1, overflow_);
+    h->SetEntries(summary_.nInTime + summary_.nOutOfTime + summary_.nOther);
+
+    static const char branchDesc[] = "nEvents/l:nInTime/l:nOutOfTime/l:nOther/l:ratio/D:low/D:high/D:confidenceLevel/D";
+    TTree* nt = tfs->make<TTree>("summary", "Extinction ratio");
+    nt->Branch("summary", &summary_, branchDesc);
+    nt->Fill();
+
+    std::ostringstream os;
+    os<<"ExtExtinctionRatio: "<<summary_.nEvents<<" events, "<<summary_.nOutOfTime<<" out-of-time / "
+      <<summary_.nInTime<<" in-time hits = "<<summary_.ratio<<", "<<100*confidenceLevel_<<"% "
+      <<(bootstrap_ ? "bootstrap" : "Clopper-Pearson")<<" interval ["<<summary_.low<<", "<<summary_.high<<"]";
+    mf::LogInfo("Summary")<<os.str();
+  }
+
+  //================================================================
+
+} // namespace mu2e
+
+DEFINE_ART_MODULE(mu2e::ExtExtinctionRatio)
@@ -0,0 +1,170 @@
+// Dead and noisy pixel mask of the ExtMonFNAL chips, see ExtMonFNALPixelMask.hh.
+
+#include "Extinction/Analysis/inc/ExtMonFNALPixelMask.hh"
+
+#include <fstream>
+#include <sstream>
+
+#include "art/Framework/Services/Registry/ServiceDefinitionMacros.h"
+#include "cetlib_except/exception.h"
+#include "messagefacility/MessageLogger/MessageLogger.h"
+
+#include "Offline/ConfigTools/inc/ConfigFileLookupPolicy.hh"
+
+namespace mu2e {
+
+  //================================================================
+  ExtMonFNALPixelMask::ExtMonFNALPixelMask(const Parameters& conf, art::ActivityRegistry& reg)
+    : cols_(conf().layout().chipPixels()[0])
+    , rows_(conf().layout().chipPixels()[1])
+    , bitsPerChip_(cols_*rows_)
+    , wordsPerChip_(bitsPerChip_/64 + 1)
+    , zeros_(wordsPerChip_, 0)
+    , learnEvents_(conf().learnEvents())
+    , learnedEvents_(0)
+    , maxOccupancy_(conf().maxOccupancy())
+    , outputFile_(conf().outputFile())
+    , hasLearner_(false)
+    , maskedPixels_(0)
+  {
+    if(cols_ == 0 || rows_ == 0 || cols_ > 1024 || rows_ > 1024) {
+      throw cet::exception("BADCONFIG")<<"ExtMonFNALPixelMask: chipPixels must be in [1, 1024]\n";
+    }
+    chips_.assign(std::size_t(1) << ExtMonPixelKey::chipBits, zeros_.data());
+    chipBits_.resize(chips_.size());
+    if(learnEvents_ > 0) {
+      counts_.resize(chips_.size());
+      reg.sPostEndJob.watch(this, &ExtMonFNALPixelMask::postEndJob);
+    }
+
+    if(!conf().maskFile().empty()) {
+      ConfigFileLookupPolicy findConfig;
+      load(findConfig(conf().maskFile()));
+      mf::LogInfo("Info")<<"ExtMonFNALPixelMask: "<<maskedPixels_<<" pixels masked from "<<conf().maskFile();
+    }
+  }
+
+  //================================================================
+  void ExtMonFNALPixelMask::mask(const ExtMonFNALPixelId& pix) {
+    if(pix.col() >= cols_ || pix.row() >= rows_) {
+      throw cet::exception("BADINPUT")<<"ExtMonFNALPixelMask: pixel ("<<pix.col()<<", "<<pix.row()
+                                      <<") outside the "<<cols_<<" x "<<rows_<<" chip\n";
+    }
+    const std::uint32_t key = ExtMonPixelKey::chip(pix.chip());
+    std::vector<std::uint64_t>& bits = chipBits_[key];
+    if(bits.empty()) {
+      bits.assign(wordsPerChip_, 0);
+      chips_[key] = bits.data();
+    }
+    const std::uint32_t bit = pix.row()*cols_ + pix.col();
+    const std::uint64_t m = std::uint64_t(1) << (bit & 63);
+    if(!(bits[bit >> 6] & m)) {
+      bits[bit >> 6] |= m;
+      ++maskedPixels_;
+    }
+  }
+
+  //================================================================
+  void ExtMonFNALPixelMask::load(const std::string& fileName) {
+    std::ifstream in(fileName);
+    if(!in) {
+      throw cet::exception("BADCONFIG")<<"ExtMonFNALPixelMask: can not open "<<fileName<<"\n";
+    }
+    std::string line;
+    unsigned lineNumber = 0;
+    while(std::getline(in, line)) {
+      ++lineNumber;
+      const std::size_t hash = line.find('#');
+      if(hash != std::string::npos) line.erase(hash);
+      std::istringstream is(line);
+      unsigned plane, module, chipCol, chipRow, col, row;
+      if(!(is>>plane)) continue; // blank or comment line
+      if(!(is>>module>>chipCol>>chipRow>>col>>row) || plane >= 32 || module >= 32 || chipCol >= 8 || chipRow >= 8) {
+        throw cet::exception("BADCONFIG")<<"ExtMonFNALPixelMask: bad line "<<lineNumber<<" in "<<fileName
+                                         <<", expect \"plane module chipCol chipRow col row\"\n";
+      }
+      mask(ExtMonFNALPixelId(ExtMonFNALChipId(ExtMonFNALModuleId(plane, module), chipCol, chipRow), col, row));
+    }
+  }
+
+  //================================================================
+  bool ExtMonFNALPixelMask::learn(const ExtMonFNALRawHitCollection& hits) {
+    if(!learning()) return false;
+
+    for(const auto& hit : hits) {
+      const ExtMonFNALPixelId& pix = hit.pixelId();
+      if(pix.col() >= cols_ || pix.row() >= rows_) continue;
+      std::vector<std::uint32_t>& c = counts_[ExtMonPixelKey::chip(pix.chip())];
+      if(c.empty()) {
+        c.assign(bitsPerChip_, 0);
+      }
+      ++c[pix.row()*cols_ + pix.col()];
+    }
+
+    if(++learnedEvents_ == learnEvents_) {
+      finishLearning();
+    }
+    return true;
+  }
+
+  //================================================================
+  void ExtMonFNALPixelMask::throwNoLearner(const std::string& module) const {
+    throw cet::exception("BADCONFIG")<<"ExtMonFNALPixelMask: "<<module<<" applies a mask that is learning from "
+                                     <<learnEvents_<<" events, but no ExtRawHitMasker in the job learns it\n";
+  }
+
+  void ExtMonFNALPixelMask::postEndJob() {
+    if(learning()) {
+      throw cet::exception("BADCONFIG")<<"ExtMonFNALPixelMask: only "<<learnedEvents_<<" of the "<<learnEvents_
+                                       <<" learnEvents were seen, the learned mask was never finished\n";
+    }
+  }
+
+  //================================================================
+  void ExtMonFNALPixelMask::finishLearning() {
+    const unsigned long before = maskedPixels_;
+    const double maxHits = maxOccupancy_*learnedEvents_;
+    for(std::uint32_t key = 0; key < counts_.size(); ++key) {
+      const std::vector<std::uint32_t>& c = counts_[key];
+      for(std::uint32_t bit = 0; bit < c.size(); ++bit) {
+        if(c[bit] > maxHits) {
+          mask(ExtMonFNALPixelId(ExtMonPixelKey::chipId(key), bit % cols_, bit / cols_));
+        }
+      }
+    }
+    std::vector<std::vector<std::uint32_t> >().swap(counts_);
+
+    mf::LogInfo("Summary")<<"ExtMonFNALPixelMask: "<<maskedPixels_ - before<<" noisy pixels learned from "
+                          <<learnedEvents_<<" events, "<<maskedPixels_<<" pixels masked";
+    if(!outputFile_.empty()) {
+      write(outputFile_);
+    }
+  }
+
+  //================================================================
+  void ExtMonFNALPixelMask::write(const std::string& fileName) const {
+    std::ofstream out(fileName);
+    if(!out) {
+      throw cet::exception("FILEWRITE")<<"ExtMonFNALPixelMask: can not open "<<fileName<<" for writing\n";
+    }
+    out<<"# ExtMonFNAL pixel mask, "<<maskedPixels_<<" pixels\n";
+    out<<"# plane module chipCol chipRow col row\n";
+    for(std::uint32_t key = 0; key < chipBits_.size(); ++key) {
+      const std::vector<std::uint64_t>& bits = chipBits_[key];
+      if(bits.empty()) continue;
+      for(std::uint32_t bit = 0; bit < bitsPerChip_; ++bit) {
+        if((bits[bit >> 6] >> (bit & 63)) & 1) {
+          out<<ExtMonPixelKey::plane(key)<<" "<<ExtMonPixelKey::moduleNumber(key)<<" "
+             <<ExtMonPixelKey::chipCol(key)<<" "<<ExtMonPixelKey::chipRow(key)<<" "
+             <<bit % cols_<<" "<<bit / cols_<<"\n";
+        }
+      }
+    }
+    if(!out) {
+      throw cet::exception("FILEWRITE")<<"ExtMonFNALPixelMask: write error on "<<fileName<<"\n";
+    }
+  }
+
+} // namespace mu2e
+
+DEFINE_ART_SERVICE(mu2e::ExtMonFNALPixelMask)
@@ -0,0 +1,150 @@
+// Pixel layout and positions of the ExtMonFNAL sensors, see ExtMonPixelGeometry.hh.
+
+#include "Extinction/Analysis/inc/ExtMonPixelGeometry.hh"
+
+#include <algorithm>
+#include <cmath>
+
+#include "cetlib_except/exception.h"
+
+#include "CLHEP/Vector/TwoVector.h"
+
+#include "Offline/ExtinctionMonitorFNAL/Geometry/inc/ExtMonFNAL.hh"
+#include "Offline/ExtinctionMonitorFNAL/Geometry/inc/ExtMonFNALPixelIdConverter.hh"
+
+#include "Extinction/Analysis/inc/ExtMonPixelKey.hh"
+
+namespace mu2e {
+
+  //================================================================
+  ExtMonPixelGeometry::ExtMonPixelGeometry(const Layout& conf) {
+    for(unsigned i = 0; i < 2; ++i) {
+      chipPixels_[i] = conf.chipPixels()[i];
+      moduleChips_[i] = conf.moduleChips()[i];
+    }
+    checkLayout();
+  }
+
+  ExtMonPixelGeometry::ExtMonPixelGeometry(const ExtMonFNAL::ExtMon& extmon)
+    : pitch_{extmon.chip().xPitch(), extmon.chip().yPitch()}
+    , chipPixels_{extmon.chip().nColumns(), extmon.chip().nRows()}
+    , moduleChips_{extmon.module().nxChips(), extmon.module().nyChips()}
+    , converter_(&extmon.pixelIdConverter())
+  {
+    checkLayout();
+    addStack(extmon.dn(), dn, 0);
+    addStack(extmon.up(), up, extmon.dn().planes().size());
+  }
+
+  void ExtMonPixelGeometry::checkLayout() const {
+    for(unsigned i = 0; i < 2; ++i) {
+      if(chipPixels_[i] < 2 || moduleChips_[i] == 0 || moduleChips_[i] > 8) {
+        throw cet::exception("BADCONFIG")<<"ExtMonPixelGeometry: need at least 2 pixels per chip side"
+                                         <<" and 1 to 8 chips per module side\n";
+      }
+    }
+  }
+
+  //================================================================
+  void ExtMonPixelGeometry::addStack(const ExtMonFNALPlaneStack& stack, Stack which, unsigned firstPlane) {
+    for(unsigned ip = 0; ip < stack.planes().size(); ++ip) {
+      const ExtMonFNALPlane& plane = stack.planes()[ip];
+      const unsigned number = firstPlane + ip;
+      const unsigned nModules = plane.module_zoffset().size();
+      if(nModules == 0) continue;
+      if(number >= 32 || nModules > 32) {
+        throw cet::exception("BADCONFIG")<<"ExtMonPixelGeometry: plane and module numbers must be below 32\n";
+      }
+
+      double sumZ = 0.;
+      for(unsigned im = 0; im < nModules; ++im) {
+        const std::uint32_t key = ExtMonPixelKey::module(ExtMonFNALModuleId(number, im));
+        if(key >= modules_.size()) {
+          modules_.resize(key + 1);
+        }
+        Placement& p = modules_[key];
+        p.present = true;
+        p.center[0] = stack.plane_xoffset()[ip] + plane.module_xoffset()[im];
+        p.center[1] = stack.plane_yoffset()[ip] + plane.module_yoffset()[im];
+        p.center[2] = stack.plane_zoffset()[ip] + plane.module_zoffset()[im];
+
+        // Rotation about z, after turning a back side module over about its v axis
+        const double phi = plane.module_rotation()[im];
+        const double flip = (plane.module_zoffset()[im] < 0.) ? -1. : 1.;
+        p.u[0] = flip*std::cos(phi);
+        p.u[1] = flip*std::sin(phi);
+        p.u[2] = 0.;
+        p.v[0] = -std::sin(phi);
+        p.v[1] = std::cos(phi);
+        p.v[2] = 0.;
+        sumZ += p.center[2];
+      }
+
+      if(number >= planeZ_.size()) {
+        planeZ_.resize(number + 1, 0.);
+      }
+      planeZ_[number] = sumZ/nModules;
+      planes_[which].push_back(number);
+    }
+
+    std::sort(planes_[which].begin(), planes_[which].end(),
+              [this](unsigned a, unsigned b) { return planeZ_[a] < planeZ_[b]; });
+  }
+
+  //================================================================
+  const ExtMonPixelGeometry::Placement& ExtMonPixelGeometry::placement(const ExtMonFNALModuleId& m) const {
+    const std::uint32_t key = ExtMonPixelKey::module(m);
+    if(key >= modules_.size() || !modules_[key].present) {
+      throw cet::exception("BADINPUT")<<"ExtMonPixelGeometry: no placement for module "<<m.number()
+                                      <<" of plane "<<m.plane()<<"\n";
+    }
+    return modules_[key];
+  }
+
+  const ExtMonFNALPixelIdConverter& ExtMonPixelGeometry::converter() const {
+    if(!converter_) {
+      throw cet::exception("BADCONFIG")<<"ExtMonPixelGeometry: pixel positions need the ExtMonFNAL geometry\n";
+    }
+    return *converter_;
+  }
+
+  bool ExtMonPixelGeometry::hasModule(const ExtMonFNALModuleId& m) const {
+    const std::uint32_t key = ExtMonPixelKey::module(m);
+    return key < modules_.size() && modules_[key].present;
+  }
+
+  double ExtMonPixelGeometry::planeZ(unsigned plane) const {
+    return planeZ_.at(plane);
+  }
+
+  //================================================================
+  CLHEP::Hep3Vector ExtMonPixelGeometry::position(const ExtMonFNALChipId& chip, double col, double row) const {
+    const Placement& p = placement(chip.module());
+    const ExtMonFNALPixelIdConverter& conv = converter();
+
+    // Pixel centres from the converter, linear in between on the chip
+    const unsigned c0 = unsigned(std::clamp(std::floor(col), 0., double(chipPixels_[0] - 1)));
+    const unsigned r0 = unsigned(std::clamp(std::floor(row), 0., double(chipPixels_[1] - 1)));
+    const unsigned c1 = (c0 + 1 < chipPixels_[0]) ? c0 + 1 : c0 - 1;
+    const unsigned r1 = (r0 + 1 < chipPixels_[1]) ? r0 + 1 : r0 - 1;
+    const CLHEP::Hep2Vector p00 = conv.modulePosition(ExtMonFNALPixelId(chip, c0, r0));
+    const CLHEP::Hep2Vector dc = (conv.modulePosition(ExtMonFNALPixelId(chip, c1, r0)) - p00)/(double(c1) - double(c0));
+    const CLHEP::Hep2Vector dr = (conv.modulePosition(ExtMonFNALPixelId(chip, c0, r1)) - p00)/(double(r1) - double(r0));
+    const CLHEP::Hep2Vector local = p00 + (col - c0)*dc + (row - r0)*dr;
+
+    return CLHEP::Hep3Vector(p.center[0] + local.x()*p.u[0] + local.y()*p.v[0],
+                             p.center[1] + local.x()*p.u[1] + local.y()*p.v[1],
+                             p.center[2] + local.x()*p.u[2] + local.y()*p.v[2]);
+  }
+
+  //================================================================
+  bool ExtMonPixelGeometry::pixel(const ExtMonFNALModuleId& m, double u, double v, ExtMonFNALPixelId& pix) const {
+    const ExtMonFNALPixelId found = converter().pixelId(m, CLHEP::Hep2Vector(u, v));
+    if(found == ExtMonFNALPixelId()) {
+      return false; // outside the sensor
+    }
+    pix = found;
+    return true;
+  }
+
+} // namespace mu2e
@@ -0,0 +1,77 @@
+// Per pixel sums over the ExtMonFNAL modules, see ExtMonPixelMap.hh.
+
+#include "Extinction/Analysis/inc/ExtMonPixelMap.hh"
+
+#include <algorithm>
+
+#include "TH2D.h"
+
+#include "art_root_io/TFileDirectory.h"
+
+#include "Extinction/Analysis/inc/ExtMonPixelGeometry.hh"
+#include "Extinction/Analysis/inc/ExtMonPixelKey.hh"
+
+namespace mu2e {
+
+  //================================================================
+  ExtMonPixelMap::ExtMonPixelMap(const ExtMonPixelGeometry& layout)
+    : chipPixels_{layout.chipPixels(0), layout.chipPixels(1)}
+    , cols_(layout.moduleChips(0)*layout.chipPixels(0))
+    , rows_(layout.moduleChips(1)*layout.chipPixels(1))
+  {}
+
+  //================================================================
+  void ExtMonPixelMap::fill(const ExtMonFNALPixelId& pix, double weight) {
+    const ExtMonFNALChipId& chip = pix.chip();
+    const std::uint32_t key = ExtMonPixelKey::module(chip.module());
+    if(key >= modules_.size()) {
+      modules_.resize(key + 1);
+      moduleEntries_.resize(key + 1, 0);
+    }
+    std::vector<double>& m = modules_[key];
+    if(m.empty()) {
+      m.assign(std::size_t(cols_)*rows_, 0.);
+    }
+    const unsigned col = chip.chipCol()*chipPixels_[0] + pix.col();
+    const unsigned row = chip.chipRow()*chipPixels_[1] + pix.row();
+    if(col < cols_ && row < rows_) {
+      m[std::size_t(row)*cols_ + col] += weight;
+      ++moduleEntries_[key];
+      ++entries_;
+    }
+  }
+
+  //================================================================
+  void ExtMonPixelMap::write(art::TFileDirectory& dir, const std::string& name, const std::string& title) const {
+    // Module keys are plane*32 + number, so the modules of a plane are contiguous
+    for(std::uint32_t plane = 0; 32*plane < modules_.size(); ++plane) {
+      const std::uint32_t first = 32*plane, last = std::min<std::uint32_t>(first + 32, modules_.size());
+      bool hit = false;
+      for(std::uint32_t key = first; key < last; ++key) {
+        hit = hit || !modules_[key].empty();
+      }
+      if(!hit) continue;
+
+      art::TFileDirectory pd = dir.mkdir("plane" + std::to_string(plane));
+      for(std::uint32_t key = first; key < last; ++key) {
+        const std::vector<double>& m = modules_[key];
+        if(m.empty()) continue;
+
+        const unsigned number = key - first;
+        const std::string hname = name + "_module" + std::to_string(number);
+        const std::string htitle = title + ", plane " + std::to_string(plane) + " module " + std::to_string(number) + ";col;row";
+        TH2D* h = pd.make<TH2D>(hname.c_str(), htitle.c_str(), cols_, -0.5, cols_ - 0.5, rows_, -0.5, rows_ - 0.5);
+        for(unsigned row = 0; row < rows_; ++row) {
+          for(unsigned col = 0; col < cols_; ++col) {
+            const double w = m[std::size_t(row)*cols_ + col];
+            if(w != 0.) {
+              h->SetBinContent(col + 1, row + 1, w);
+            }
+          }
+        }
+        h->SetEntries(double(moduleEntries_[key]));
+      }
+    }
+  }
+
+} // namespace mu2e
@@ -0,0 +1,286 @@
+// Cluster ExtMonFNAL raw hits in space and time.
+//
+// Hits on the same chip are joined when their pixels touch (sharing a
+// side, or also a corner with diagonal) and their clocks differ by at most
+// clockWindow.  The hits are radix sorted by (chip, clock), so the
+// candidates of a hit are the following hits of the same chip up to
+// clockWindow later, and joined with union-find.  Clusters do not cross
+// chip boundaries.
+//
+// The clusters are written as an ExtMonFNALRawClusterCollection ordered by
+// (chip, first clock), with the hits of a cluster in (clock, input) order.
+// With writeNtuple one row per cluster, with the centroid of
+// clusterCentroid() in chip pixel units, goes to the "nt" tree.  With
+// applyPixelMask the hits masked by ExtMonFNALPixelMask are left out of
+// all clusters.
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstdlib>
+#include <sstream>
+#include <utility>
+
+#include "cetlib_except/exception.h"
+
+#include "TTree.h"
+
+#include "canvas/Utilities/InputTag.h"
+#include "canvas/Persistency/Common/Ptr.h"
+#include "canvas/Persistency/Common/PtrVector.h"
+#include "art/Framework/Core/EDProducer.h"
+#include "fhiclcpp/types/Atom.h"
+#include "art/Framework/Principal/Event.h"
+#include "art/Framework/Principal/Handle.h"
+#include "art_root_io/TFileService.h"
+#include "messagefacility/MessageLogger/MessageLogger.h"
+
+#include "Offline/RecoDataProducts/inc/ExtMonFNALRawHit.hh"
+#include "Offline/RecoDataProducts/inc/ExtMonFNALRawCluster.hh"
+
+#include "Extinction/Analysis/inc/ExtMonClusterCentroid.hh"
+#include "Extinction/Analysis/inc/ExtMonFNALPixelMask.hh"
+#include "Extinction/Analysis/inc/ExtMonPixelKey.hh"
+#include "Extinction/Analysis/inc/RadixSort.hh"
+
+
+namespace mu2e {
+
+  //================================================================
+
+  struct ExtRawCluster {
+
+          int RunID;
+          int SubRunID;
+          long long EventID;
+          unsigned int planeId;
+          unsigned int moduleId;
+          unsigned int chipCol;
+          unsigned int chipRow;
+          unsigned int nHits;
+          unsigned int colMin;
+          unsigned int colMax;
+          unsigned int rowMin;
+          unsigned int rowMax;
+          int clockMin;
+          int clockMax;
+          int totSum;
+          float Col;
+          float Row;
+
+    ExtRawCluster() :  RunID(-1), SubRunID(-1), EventID(-1),
+                   planeId(-1), moduleId(-1),
+                   chipCol(-1), chipRow(-1),
+                   nHits(0), colMin(-1), colMax(0), rowMin(-1), rowMax(0),
+                   clockMin(0), clockMax(0), totSum(0),
+                   Col(0), Row(0)
+                {}
+
+  }; // struct ExtRawCluster
+
+  //================================================================
+  class ExtRawHitClusterer : public art::EDProducer {
+    struct Config {
+      using Name=fhicl::Name;
+      using Comment=fhicl::Comment;
+      fhicl::Atom<std::string> hits     {Name("hitsInputTag"     ), Comment("ExtMonFNALRawHit collection")};
+      fhicl::Atom<unsigned> clockWindow{Name("clockWindow"), Comment("Largest clock difference of joined hits"), 1};
+      fhicl::Atom<bool> diagonal{Name("diagonal"), Comment("Join pixels touching at a corner"), true};
+      fhicl::Atom<bool> writeNtuple{Name("writeNtuple"), Comment("Write one row per cluster to the \"nt\" tree"), false};
+      fhicl::Atom<bool> applyPixelMask{Name("applyPixelMask"), Comment("Skip hits masked by the ExtMonFNALPixelMask service"), false};
+    };
+
+    typedef art::EDProducer::Table<Config> Parameters;
+
+  protected:
+
+    art::InputTag hitsInputTag_;
+    int clockWindow_;
+    bool diagonal_;
+    bool writeNtuple_;
+    const ExtMonFNALPixelMask* mask_;
+    TTree *nt_;
+    ExtRawCluster cluster_;
+
+    // Per event work arrays, kept to reuse their capacity
+    std::vector<std::uint64_t> keys_;
+    std::vector<std::uint32_t> order_;
+    std::vector<std::uint32_t> parent_;
+    std::vector<std::uint32_t> size_;
+    std::vector<std::int32_t> clusterOf_;
+
+    unsigned long numEvents_;
+    unsigned long numHits_;
+    unsigned long numClusters_;
+
+    std::uint32_t findRoot(std::uint32_t i);
+    void unite(std::uint32_t a, std::uint32_t b);
+    bool adjacent(const ExtMonFNALPixelId& a, const ExtMonFNALPixelId& b) const;
+
+    public:
+    explicit ExtRawHitClusterer(const Parameters& pset);
+    virtual void beginJob();
+    virtual void produce(art::Event& event);
+    virtual void endJob();
+  };
+
+  //================================================================
+  ExtRawHitClusterer::ExtRawHitClusterer(const Parameters& pset)
+    : art::EDProducer(pset)
+      , hitsInputTag_(pset().hits())
+      , clockWindow_(pset().clockWindow())
+      , diagonal_(pset().diagonal())
+      , writeNtuple_(pset().writeNtuple())
+      , mask_(pset().applyPixelMask() ? &*art::ServiceHandle<ExtMonFNALPixelMask>() : nullptr)
+      , nt_(0)
+      , numEvents_(0)
+      , numHits_(0)
+      , numClusters_(0)
+  {
+    produces<ExtMonFNALRawClusterCollection>();
+  }
+
+  //================================================================
+  void ExtRawHitClusterer::beginJob() {
+    if(writeNtuple_) {
+      art::ServiceHandle<art::TFileService> tfs;
+      static const char branchDesc[] = "RunID/I:SubRunID/I:EventID/L:planeId/i:moduleId/i:chipCol/i:chipRow/i:nHits/i:colMin/i:colMax/i:rowMin/i:rowMax/i:clockMin/I:clockMax/I:totSum/I:Col/F:Row/F";
+      nt_ = tfs->make<TTree>( "nt", "ExtRawClusters ntuple");
+      nt_->Branch("clusters", &cluster_, branchDesc);
+    }
+  }
+
+  //================================================================
+  std::uint32_t ExtRawHitClusterer::findRoot(std::uint32_t i) {
+    while(parent_[i] != i) {
+      parent_[i] = parent_[parent_[i]]; // path halving
+      i = parent_[i];
+    }
+    return i;
+  }
+
+  void ExtRawHitClusterer::unite(std::uint32_t a, std::uint32_t b) {
+    a = findRoot(a);
+    b = findRoot(b);
+    if(a == b) return;
+    if(size_[a] < size_[b]) std::swap(a, b);
+    parent_[b] = a;
+    size_[a] += size_[b];
+  }
+
+  bool ExtRawHitClusterer::adjacent(const ExtMonFNALPixelId& a, const ExtMonFNALPixelId& b) const {
+    const int dc = std::abs(int(a.col()) - int(b.col()));
+    const int dr = std::abs(int(a.row()) - int(b.row()));
+    return diagonal_ ? (dc <= 1 && dr <= 1) : (dc + dr <= 1);
+  }
+
+  //================================================================
+
+  void ExtRawHitClusterer::produce(art::Event& event) {
+
+    if(mask_) mask_->checkLearner("ExtRawHitClusterer");
+
+    const auto ih = event.getValidHandle<ExtMonFNALRawHitCollection>(hitsInputTag_);
+    const ExtMonFNALRawHitCollection& hits(*ih);
+    const std::size_t n = hits.size();
+
+    // Masked hits get a chip key above all chips, so they sort last and are cut off
+    keys_.resize(n);
+    std::size_t kept = 0;
+    for(std::size_t i = 0; i < n; ++i) {
+      const bool masked = mask_ && mask_->masked(hits[i].pixelId());
+      const std::uint64_t chip = masked ? 0xffffffffu : ExtMonPixelKey::chip(hits[i].pixelId().chip());
+      keys_[i] = (chip << 32) | radixKey(hits[i].clock());
+      kept += !masked;
+    }
+    radixSortIndices(keys_, order_);
+    order_.resize(kept);
+
+    parent_.resize(n);
+    size_.assign(n, 1);
+    for(std::size_t i = 0; i < n; ++i) {
+      parent_[i] = i;
+    }
+
+    // Candidates of a hit: the following hits on the same chip within clockWindow
+    for(std::size_t a = 0; a < kept; ++a) {
+      const ExtMonFNALRawHit& ha = hits[order_[a]];
+      const std::uint64_t chipA = keys_[order_[a]] >> 32;
+      for(std::size_t b = a + 1; b < kept; ++b) {
+        const ExtMonFNALRawHit& hb = hits[order_[b]];
+        if((keys_[order_[b]] >> 32) != chipA || hb.clock() - ha.clock() > clockWindow_) break;
+        if(adjacent(ha.pixelId(), hb.pixelId())) {
+          unite(order_[a], order_[b]);
+        }
+      }
+    }
+
+    // Number the clusters in sorted order of their first hit
+    std::unique_ptr<ExtMonFNALRawClusterCollection> output(new ExtMonFNALRawClusterCollection);
+    std::vector<art::PtrVector<ExtMonFNALRawHit> > clusterHits;
+    clusterOf_.assign(n, -1);
+    for(std::size_t a = 0; a < kept; ++a) {
+      const std::uint32_t root = findRoot(order_[a]);
+      if(clusterOf_[root] < 0) {
+        clusterOf_[root] = clusterHits.size();
+        clusterHits.emplace_back();
+      }
+      clusterHits[clusterOf_[root]].push_back(art::Ptr<ExtMonFNALRawHit>(ih, order_[a]));
+    }
+
+    output->reserve(clusterHits.size());
+    for(const auto& ch : clusterHits) {
+      output->emplace_back(ch);
+
+      if(writeNtuple_) {
+        cluster_ = ExtRawCluster();
+        cluster_.RunID = event.run();
+        cluster_.SubRunID = event.subRun();
+        cluster_.EventID = event.event();
+        const ExtMonFNALChipId& chip = ch.front()->pixelId().chip();
+        cluster_.planeId = chip.module().plane();
+        cluster_.moduleId = chip.module().number();
+        cluster_.chipCol = chip.chipCol();
+        cluster_.chipRow = chip.chipRow();
+        cluster_.nHits = ch.size();
+        cluster_.clockMin = ch.front()->clock();
+        cluster_.clockMax = ch.back()->clock();
+        for(const auto& h : ch) {
+          const unsigned col = h->pixelId().col(), row = h->pixelId().row();
+          if(col < cluster_.colMin) cluster_.colMin = col;
+          if(col > cluster_.colMax) cluster_.colMax = col;
+          if(row < cluster_.rowMin) cluster_.rowMin = row;
+          if(row > cluster_.rowMax) cluster_.rowMax = row;
+          cluster_.totSum += h->tot();
+        }
+        double col = 0, row = 0;
+        clusterCentroid(ch, col, row);
+        cluster_.Col = col;
+        cluster_.Row = row;
+        nt_->Fill();
+      }
+    }
+
+    ++numEvents_;
+    numHits_ += kept;
+    numClusters_ += output->size();
+    event.put(std::move(output));
+  }
+
+  //================================================================
+
+  void ExtRawHitClusterer::endJob() {
+    std::ostringstream os;
+    os<<"ExtRawHitClusterer: "<<numClusters_<<" clusters from "<<numHits_<<" hits in "<<numEvents_<<" events";
+    if(numClusters_ > 0) {
+      os<<", "<<double(numHits_)/numClusters_<<" hits per cluster";
+    }
+    mf::LogInfo("Summary")<<os.str();
+  }
+
+  //================================================================
+
+} // namespace mu2e
+
+DEFINE_ART_MODULE(mu2e::ExtRawHitClusterer)
@@ -1,11 +1,18 @@
 // Ntuple dumper for MCs.
 //
+// The output parameter selects the "nt" tree with one row per hit, the
+// bit-packed binary stream of ExtRawHitStream (one 64 bit word per hit,
+// blocked per event, written to packedFileName), or both.  With
+// applyPixelMask the hits masked by ExtMonFNALPixelMask are left out.
+//
 // Andrei Gaponenko, 2013
 
 #include <string>
 #include <vector>
 #include <limits>
 #include <cmath>
+#include <cstdint>
+#include <memory>
 
 #include "cetlib_except/exception.h"
 #include "CLHEP/Vector/ThreeVector.h"
@@ -23,6 +30,7 @@
 #include "art/Framework/Principal/Run.h"
 #include "art/Framework/Principal/Provenance.h"
 #include "art_root_io/TFileService.h"
+#include "messagefacility/MessageLogger/MessageLogger.h"
 
 #include "Offline/GlobalConstantsService/inc/GlobalConstantsHandle.hh"
 #include "Offline/GlobalConstantsService/inc/ParticleDataList.hh"
@@ -33,6 +41,9 @@
 #include "KinKal/General/ParticleState.hh"
 #include "Offline/RecoDataProducts/inc/ExtMonFNALRawHit.hh"
 
+#include "Extinction/Analysis/inc/ExtMonFNALPixelMask.hh"
+#include "Extinction/Analysis/inc/ExtRawHitStream.hh"
+
 
 namespace mu2e {
 
@@ -75,6 +86,11 @@ namespace mu2e {
       using Name=fhicl::Name;
       using Comment=fhicl::Comment;
       fhicl::Atom<std::string> hits     {Name("hitsInputTag"     ), Comment("MC collection")};
+      fhicl::Atom<std::string> output{Name("output"),
+          Comment("\"tree\", \"packed\" or \"both\", see ExtRawHitStream"), "tree"};
+      fhicl::Atom<std::string> packedFileName{Name("packedFileName"),
+          Comment("Binary stream file for the packed output"), "ExtRawHits.emfraw"};
+      fhicl::Atom<bool> applyPixelMask{Name("applyPixelMask"), Comment("Skip hits masked by the ExtMonFNALPixelMask service"), false};
     };
 
     typedef art::EDAnalyzer::Table<Config> Parameters;
@@ -82,38 +98,81 @@ namespace mu2e {
   protected:
 
     art::InputTag hitsInputTag_;
+    bool writeTree_;
+    bool writePacked_;
+    std::string packedFileName_;
+    const ExtMonFNALPixelMask* mask_;
     TTree *nt_;
     ExtRawHit hit_;
 
+    std::unique_ptr<ExtRawHitStream::Writer> stream_;
+    std::vector<std::uint64_t> words_;
+
     public:
     explicit ExtRawHitDumper(const Parameters& pset);
     virtual void beginJob();
     virtual void analyze(const art::Event& event);
+    virtual void endJob();
   };
 
   //================================================================
   ExtRawHitDumper::ExtRawHitDumper(const Parameters& pset)
     : art::EDAnalyzer(pset)
       , hitsInputTag_(pset().hits())
+      , writeTree_(pset().output() != "packed")
+      , writePacked_(pset().output() != "tree")
+      , packedFileName_(pset().packedFileName())
+      , mask_(pset().applyPixelMask() ? &*art::ServiceHandle<ExtMonFNALPixelMask>() : nullptr)
       , nt_(0)
   {
-
+    if(pset().output() != "tree" && pset().output() != "packed" && pset().output() != "both") {
+      throw cet::exception("BADCONFIG")<<"ExtRawHitDumper: unknown output \""<<pset().output()
+                                       <<"\", expect tree, packed or both\n";
+    }
   }
 
   //================================================================
   void ExtRawHitDumper::beginJob() {
-    art::ServiceHandle<art::TFileService> tfs;
-    static const char branchDesc[] = "RunID/I:SubRunID/I:EventID/L:planeId/i:moduleId/i:chipCol/i:chipRow/i:Col/i:Row/i:clock/I:tot/i";
-    nt_ = tfs->make<TTree>( "nt", "ExtRawHits ntuple");
-    nt_->Branch("hits", &hit_, branchDesc);
+    if(writeTree_) {
+      art::ServiceHandle<art::TFileService> tfs;
+      static const char branchDesc[] = "RunID/I:SubRunID/I:EventID/L:planeId/i:moduleId/i:chipCol/i:chipRow/i:Col/i:Row/i:clock/I:tot/i";
+      nt_ = tfs->make<TTree>( "nt", "ExtRawHits ntuple");
+      nt_->Branch("hits", &hit_, branchDesc);
+    }
+    if(writePacked_) {
+      stream_ = std::make_unique<ExtRawHitStream::Writer>(packedFileName_);
+    }
   }
 
   //================================================================
 
   void ExtRawHitDumper::analyze(const art::Event& event) {
 
+    if(mask_) mask_->checkLearner("ExtRawHitDumper");
+
     const auto& ih = event.getValidHandle<ExtMonFNALRawHitCollection>(hitsInputTag_);
 
+    if(writePacked_) {
+      words_.clear();
+      for(std::size_t k = 0; k < ih->size(); ++k) {
+        const ExtMonFNALRawHit& h = (*ih)[k];
+        if(mask_ && mask_->masked(h.pixelId())) continue;
+        const ExtMonFNALChipId& chip = h.pixelId().chip();
+        const ExtRawHitStream::Hit packed{chip.module().plane(), chip.module().number(),
+            chip.chipCol(), chip.chipRow(), h.pixelId().col(), h.pixelId().row(),
+            h.clock(), unsigned(h.tot())};
+        std::uint64_t word;
+        if(!ExtRawHitStream::pack(packed, word)) {
+          throw cet::exception("BADINPUT")<<"ExtRawHitDumper: hit "<<k<<" of event "<<event.id()
+                                          <<" does not fit the packed format\n";
+        }
+        words_.push_back(word);
+      }
+      stream_->add(event.run(), event.subRun(), event.event(), words_);
+    }
+
+    if(!writeTree_) return;
+
     for(const auto& i : *ih) {
 
       //std::cout<<"run "<<event.run()<<", subrun "<<event.subRun()<<", event "<<event.event()
@@ -123,6 +182,7 @@ namespace mu2e {
       //        <<", end : ("<<i->localEndPosition().x()<<", "<<i->localEndPosition().y()<<", "<<i->localEndPosition().z()<<", t = "<<i->endTime()<<") "              
       //        <<std::endl;
 
+      if(mask_ && mask_->masked(i.pixelId())) continue;
       hit_ = ExtRawHit(event.run(), event.subRun(), event.event(), i);
       nt_->Fill();
     }
@@ -130,6 +190,16 @@ namespace mu2e {
 
   //================================================================
 
+  void ExtRawHitDumper::endJob() {
+    if(stream_) {
+      stream_->close();
+      mf::LogInfo("Summary")<<"ExtRawHitDumper: "<<stream_->numHits()<<" hits of "<<stream_->numEvents()
+                            <<" events packed into "<<packedFileName_;
+    }
+  }
+
+  //================================================================
+
 } // namespace mu2e
 
 DEFINE_ART_MODULE(mu2e::ExtRawHitDumper)
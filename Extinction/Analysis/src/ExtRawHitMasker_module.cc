@@ -0,0 +1,118 @@
+// Apply the ExtMonFNALPixelMask to ExtMonFNAL raw hits.
+//
+// While the mask service is learning, the hits of each event are counted
+// towards the occupancy.  Those events only see the mask as loaded so
+// far, so the filter rejects them; modules after it on the path, and end
+// path modules selecting the path, only see events with the final mask.
+// The unmasked hits are written, in input order, as a new
+// ExtMonFNALRawHitCollection, so downstream jobs can read the masked hits
+// without the service; with writeMaskedHits false the module only feeds
+// the learning and the event selection.
+
+#include <string>
+#include <memory>
+#include <sstream>
+
+#include "canvas/Utilities/InputTag.h"
+#include "art/Framework/Core/EDFilter.h"
+#include "fhiclcpp/types/Atom.h"
+#include "art/Framework/Principal/Event.h"
+#include "art/Framework/Principal/Handle.h"
+#include "art/Framework/Services/Registry/ServiceHandle.h"
+#include "messagefacility/MessageLogger/MessageLogger.h"
+
+#include "Offline/RecoDataProducts/inc/ExtMonFNALRawHit.hh"
+
+#include "Extinction/Analysis/inc/ExtMonFNALPixelMask.hh"
+
+
+namespace mu2e {
+
+  //================================================================
+  class ExtRawHitMasker : public art::EDFilter {
+    struct Config {
+      using Name=fhicl::Name;
+      using Comment=fhicl::Comment;
+      fhicl::Atom<std::string> hits     {Name("hitsInputTag"     ), Comment("ExtMonFNALRawHit collection")};
+      fhicl::Atom<bool> writeMaskedHits{Name("writeMaskedHits"), Comment("Produce the collection of unmasked hits"), true};
+    };
+
+    typedef art::EDFilter::Table<Config> Parameters;
+
+  protected:
+
+    art::InputTag hitsInputTag_;
+    bool writeMaskedHits_;
+    ExtMonFNALPixelMask* mask_;
+
+    unsigned long numEvents_;
+    unsigned long numLearning_;
+    unsigned long numHits_;
+    unsigned long numKept_;
+
+    public:
+    explicit ExtRawHitMasker(const Parameters& pset);
+    virtual bool filter(art::Event& event);
+    virtual void endJob();
+  };
+
+  //================================================================
+  ExtRawHitMasker::ExtRawHitMasker(const Parameters& pset)
+    : art::EDFilter(pset)
+      , hitsInputTag_(pset().hits())
+      , writeMaskedHits_(pset().writeMaskedHits())
+      , mask_(&*art::ServiceHandle<ExtMonFNALPixelMask>())
+      , numEvents_(0)
+      , numLearning_(0)
+      , numHits_(0)
+      , numKept_(0)
+  {
+    mask_->setLearner();
+    if(writeMaskedHits_) {
+      produces<ExtMonFNALRawHitCollection>();
+    }
+  }
+
+  //================================================================
+
+  bool ExtRawHitMasker::filter(art::Event& event) {
+
+    const auto& ih = event.getValidHandle<ExtMonFNALRawHitCollection>(hitsInputTag_);
+    const bool learned = mask_->learn(*ih);
+
+    ++numEvents_;
+    numHits_ += ih->size();
+    if(learned) {
+      ++numLearning_;
+    }
+    if(!writeMaskedHits_) return !learned;
+
+    std::unique_ptr<ExtMonFNALRawHitCollection> output(new ExtMonFNALRawHitCollection);
+    output->reserve(ih->size());
+    for(const auto& hit : *ih) {
+      if(!mask_->masked(hit.pixelId())) {
+        output->push_back(hit);
+      }
+    }
+    numKept_ += output->size();
+    event.put(std::move(output));
+    return !learned;
+  }
+
+  //================================================================
+
+  void ExtRawHitMasker::endJob() {
+    std::ostringstream os;
+    os<<"ExtRawHitMasker: "<<numHits_<<" hits in "<<numEvents_<<" events, "<<numLearning_
+      <<" of them rejected while learning, "<<mask_->maskedPixels()<<" pixels masked";
+    if(writeMaskedHits_) {
+      os<<", "<<numKept_<<" hits kept";
+    }
+    mf::LogInfo("Summary")<<os.str();
+  }
+
+  //================================================================
+
+} // namespace mu2e
+
+DEFINE_ART_MODULE(mu2e::ExtRawHitMasker)
@@ -0,0 +1,182 @@
+// Overlay ExtMonFNAL raw hits of pre-simulated events into one readout
+// frame of several proton pulses, for rate studies without rerunning
+// Geant4 at every intensity.
+//
+// The pre-simulated events are read from ExtRawHitStream files, written
+// by ExtRawHitDumper with output "packed" from e.g. single ExtMonFNALGun
+// events.  Each entry of pulseClocks is one pulse: it gets a Poisson
+// number, mean meanEventsPerPulse (or exactly that number rounded with
+// poisson false), of events drawn uniformly from all input files, and
+// their hit clocks are shifted by the pulse clock.
+//
+// The hits are not copied on the way: the event keeps pointers to the
+// words of the mapped files and one radix key per hit in a per event
+// arena, sorts by shifted clock with radixSortIndices, and decodes each
+// word once into the output ExtMonFNALRawHitCollection.  Equal clocks keep
+// the pulse and input order.  Hits on the same pixel and clock are kept
+// as separate hits.
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <sstream>
+
+#include "cetlib_except/exception.h"
+
+#include "CLHEP/Random/RandFlat.h"
+#include "CLHEP/Random/RandPoissonQ.h"
+
+#include "art/Framework/Core/EDProducer.h"
+#include "fhiclcpp/types/Atom.h"
+#include "fhiclcpp/types/Sequence.h"
+#include "art/Framework/Principal/Event.h"
+#include "art/Framework/Services/Registry/ServiceHandle.h"
+#include "messagefacility/MessageLogger/MessageLogger.h"
+
+#include "Offline/SeedService/inc/SeedService.hh"
+#include "Offline/RecoDataProducts/inc/ExtMonFNALRawHit.hh"
+
+#include "Extinction/Analysis/inc/ExtRawHitStream.hh"
+#include "Extinction/Analysis/inc/RadixSort.hh"
+
+
+namespace mu2e {
+
+  //================================================================
+  class ExtRawHitOverlay : public art::EDProducer {
+    struct Config {
+      using Name=fhicl::Name;
+      using Comment=fhicl::Comment;
+      fhicl::Sequence<std::string> inputFiles{Name("inputFiles"), Comment("ExtRawHitStream files of the pre-simulated events")};
+      fhicl::Sequence<int> pulseClocks{Name("pulseClocks"), Comment("Clock offset of each pulse in the frame"), std::vector<int>{0}};
+      fhicl::Atom<double> meanEventsPerPulse{Name("meanEventsPerPulse"), Comment("Mean number of pre-simulated events per pulse")};
+      fhicl::Atom<bool> poisson{Name("poisson"), Comment("Poisson number of events per pulse, else the rounded mean"), true};
+      fhicl::Atom<unsigned> arenaBytes{Name("arenaBytes"), Comment("Initial size of the per event arena"), 1u << 20};
+    };
+
+    typedef art::EDProducer::Table<Config> Parameters;
+
+  protected:
+
+    std::vector<std::unique_ptr<ExtRawHitStream::Reader> > readers_;
+    std::vector<std::uint64_t> firstEvent_; // of each reader in the global event number, plus the total
+    std::vector<int> pulseClocks_;
+    double meanEventsPerPulse_;
+    bool poisson_;
+
+    CLHEP::HepRandomEngine& engine_;
+    CLHEP::RandFlat randFlat_;
+    CLHEP::RandPoissonQ randPoisson_;
+
+    // Per event arena, released at the start of each event
+    std::vector<std::byte> arenaBuffer_;
+    std::pmr::monotonic_buffer_resource arena_;
+
+    unsigned long numEvents_;
+    unsigned long numOverlaid_;
+    unsigned long numHits_;
+
+    public:
+    explicit ExtRawHitOverlay(const Parameters& pset);
+    virtual void produce(art::Event& event);
+    virtual void endJob();
+  };
+
+  //================================================================
+  ExtRawHitOverlay::ExtRawHitOverlay(const Parameters& pset)
+    : art::EDProducer(pset)
+      , pulseClocks_(pset().pulseClocks())
+      , meanEventsPerPulse_(pset().meanEventsPerPulse())
+      , poisson_(pset().poisson())
+      , engine_(createEngine(art::ServiceHandle<SeedService>()->getSeed()))
+      , randFlat_(engine_)
+      , randPoisson_(engine_)
+      , arenaBuffer_(pset().arenaBytes())
+      , arena_(arenaBuffer_.data(), arenaBuffer_.size())
+      , numEvents_(0)
+      , numOverlaid_(0)
+      , numHits_(0)
+  {
+    if(!(meanEventsPerPulse_ >= 0.) || pulseClocks_.empty()) {
+      throw cet::exception("BADCONFIG")<<"ExtRawHitOverlay: need at least one pulse and meanEventsPerPulse >= 0\n";
+    }
+
+    firstEvent_.push_back(0);
+    for(const auto& f : pset().inputFiles()) {
+      readers_.push_back(std::make_unique<ExtRawHitStream::Reader>(f));
+      firstEvent_.push_back(firstEvent_.back() + readers_.back()->numEvents());
+    }
+    if(firstEvent_.back() == 0) {
+      throw cet::exception("BADCONFIG")<<"ExtRawHitOverlay: no events in the input files\n";
+    }
+
+    produces<ExtMonFNALRawHitCollection>();
+  }
+
+  //================================================================
+
+  void ExtRawHitOverlay::produce(art::Event& event) {
+
+    arena_.release();
+    std::pmr::vector<const std::uint64_t*> words(&arena_);
+    std::pmr::vector<std::int32_t> offsets(&arena_);
+    std::pmr::vector<std::uint64_t> keys(&arena_);
+
+    const std::uint64_t total = firstEvent_.back();
+    for(const int pulseClock : pulseClocks_) {
+      const long n = poisson_ ? randPoisson_.fire(meanEventsPerPulse_) : std::lround(meanEventsPerPulse_);
+      for(long k = 0; k < n; ++k) {
+        const std::uint64_t g = std::min<std::uint64_t>(total - 1, randFlat_.fire()*total);
+        const std::size_t r = std::upper_bound(firstEvent_.begin(), firstEvent_.end(), g) - firstEvent_.begin() - 1;
+        const std::uint64_t e = g - firstEvent_[r];
+        const std::uint64_t* w = readers_[r]->words(e);
+        const std::uint32_t nw = readers_[r]->event(e).numHits;
+        for(std::uint32_t i = 0; i < nw; ++i) {
+          words.push_back(w + i);
+          offsets.push_back(pulseClock);
+          keys.push_back(radixKey(ExtRawHitStream::clock(w[i]) + pulseClock));
+        }
+        ++numOverlaid_;
+      }
+    }
+
+    const std::size_t n = words.size();
+    std::pmr::vector<std::uint32_t> order(n, &arena_);
+    std::pmr::vector<std::uint32_t> buffer(n, &arena_);
+    radixSortIndices(keys.data(), n, order.data(), buffer.data());
+
+    std::unique_ptr<ExtMonFNALRawHitCollection> output(new ExtMonFNALRawHitCollection);
+    output->reserve(n);
+    for(std::size_t i = 0; i < n; ++i) {
+      const ExtRawHitStream::Hit h = ExtRawHitStream::unpack(*words[order[i]]);
+      const ExtMonFNALChipId chip(ExtMonFNALModuleId(h.plane, h.module), h.chipCol, h.chipRow);
+      output->emplace_back(ExtMonFNALPixelId(chip, h.col, h.row), h.clock + offsets[order[i]], int(h.tot));
+    }
+
+    ++numEvents_;
+    numHits_ += n;
+    event.put(std::move(output));
+  }
+
+  //================================================================
+
+  void ExtRawHitOverlay::endJob() {
+    std::ostringstream os;
+    os<<"ExtRawHitOverlay: "<<numOverlaid_<<" pre-simulated events from "<<firstEvent_.back()
+      <<" overlaid into "<<numEvents_<<" frames of "<<pulseClocks_.size()<<" pulses, "<<numHits_<<" hits";
+    if(numEvents_ > 0) {
+      os<<", "<<double(numHits_)/numEvents_<<" hits per frame";
+    }
+    mf::LogInfo("Summary")<<os.str();
+  }
+
+  //================================================================
+
+} // namespace mu2e
+
+DEFINE_ART_MODULE(mu2e::ExtRawHitOverlay)
@@ -0,0 +1,138 @@
+// Compact binary stream of ExtMonFNAL raw hits, see ExtRawHitStream.hh.
+
+#include "Extinction/Analysis/inc/ExtRawHitStream.hh"
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cetlib_except/exception.h"
+
+namespace mu2e {
+  namespace ExtRawHitStream {
+
+    namespace {
+      Header makeHeader(std::uint64_t numEvents, std::uint64_t numHits, std::uint64_t indexOffset) {
+        Header h;
+        std::memset(&h, 0, sizeof(h));
+        std::memcpy(h.magic, magic, sizeof(magic));
+        h.version = version;
+        h.headerSize = sizeof(Header);
+        h.numEvents = numEvents;
+        h.numHits = numHits;
+        h.indexOffset = indexOffset;
+        return h;
+      }
+    }
+
+    //================================================================
+    Writer::Writer(const std::string& fileName)
+      : fileName_(fileName), file_(std::fopen(fileName.c_str(), "wb")), numHits_(0)
+    {
+      if(!file_) {
+        throw cet::exception("BADCONFIG")<<"ExtRawHitStream: can not open "<<fileName<<" for writing\n";
+      }
+      const Header h = makeHeader(0, 0, 0);
+      if(std::fwrite(&h, sizeof(h), 1, file_) != 1) {
+        throw cet::exception("FILEWRITE")<<"ExtRawHitStream: write error on "<<fileName_<<"\n";
+      }
+    }
+
+    Writer::~Writer() {
+      if(file_) {
+        try { close(); } catch(...) {}
+      }
+    }
+
+    void Writer::add(std::uint32_t run, std::uint32_t subRun, std::uint32_t event,
+                     const std::vector<std::uint64_t>& words) {
+      index_.push_back(EventEntry{run, subRun, event, std::uint32_t(words.size()), numHits_});
+      if(!words.empty() && std::fwrite(words.data(), sizeof(std::uint64_t), words.size(), file_) != words.size()) {
+        throw cet::exception("FILEWRITE")<<"ExtRawHitStream: write error on "<<fileName_<<"\n";
+      }
+      numHits_ += words.size();
+    }
+
+    void Writer::close() {
+      if(!file_) return;
+      const std::uint64_t indexOffset = sizeof(Header) + numHits_*sizeof(std::uint64_t);
+      const Header h = makeHeader(index_.size(), numHits_, indexOffset);
+      const bool ok = (index_.empty() || std::fwrite(index_.data(), sizeof(EventEntry), index_.size(), file_) == index_.size())
+        && std::fseek(file_, 0, SEEK_SET) == 0
+        && std::fwrite(&h, sizeof(h), 1, file_) == 1;
+      const bool closed = std::fclose(file_) == 0;
+      file_ = nullptr;
+      if(!ok || !closed) {
+        throw cet::exception("FILEWRITE")<<"ExtRawHitStream: write error on "<<fileName_<<"\n";
+      }
+    }
+
+    //================================================================
+    Reader::Reader(const std::string& fileName)
+      : fileName_(fileName), data_(MAP_FAILED), size_(0), header_(nullptr), words_(nullptr), index_(nullptr)
+    {
+      const int fd = ::open(fileName.c_str(), O_RDONLY);
+      struct stat st;
+      if(fd < 0 || ::fstat(fd, &st) != 0) {
+        if(fd >= 0) ::close(fd);
+        throw cet::exception("BADINPUT")<<"ExtRawHitStream: can not open "<<fileName<<"\n";
+      }
+      size_ = st.st_size;
+      if(size_ >= sizeof(Header)) {
+        data_ = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      }
+      ::close(fd);
+      if(data_ == MAP_FAILED) {
+        throw cet::exception("BADINPUT")<<"ExtRawHitStream: can not map "<<fileName<<"\n";
+      }
+
+      header_ = static_cast<const Header*>(data_);
+      if(std::memcmp(header_->magic, magic, sizeof(magic)) != 0 || header_->version != version
+         || header_->headerSize != sizeof(Header)
+         || header_->numHits > size_/sizeof(std::uint64_t) || header_->numEvents > size_/sizeof(EventEntry)
+         || header_->indexOffset != sizeof(Header) + header_->numHits*sizeof(std::uint64_t)
+         || size_ != header_->indexOffset + header_->numEvents*sizeof(EventEntry)) {
+        ::munmap(data_, size_);
+        throw cet::exception("BADINPUT")<<"ExtRawHitStream: "<<fileName<<" is not a complete version "
+                                        <<version<<" raw hit stream\n";
+      }
+      const char* base = static_cast<const char*>(data_);
+      words_ = reinterpret_cast<const std::uint64_t*>(base + header_->headerSize);
+      index_ = reinterpret_cast<const EventEntry*>(base + header_->indexOffset);
+
+      for(std::uint64_t i = 0; i < header_->numEvents; ++i) {
+        if(index_[i].firstHit > header_->numHits || index_[i].numHits > header_->numHits - index_[i].firstHit) {
+          ::munmap(data_, size_);
+          throw cet::exception("BADINPUT")<<"ExtRawHitStream: event entry "<<i<<" of "<<fileName
+                                          <<" points past the hit words\n";
+        }
+      }
+    }
+
+    Reader::~Reader() {
+      ::munmap(data_, size_);
+    }
+
+    const EventEntry& Reader::event(std::uint64_t i) const {
+      if(i >= header_->numEvents) {
+        throw cet::exception("BADINPUT")<<"ExtRawHitStream: event "<<i<<" requested from "<<fileName_
+                                        <<" with "<<header_->numEvents<<" events\n";
+      }
+      return index_[i];
+    }
+
+    void Reader::decode(std::uint64_t i, std::vector<Hit>& hits) const {
+      const EventEntry& e = event(i);
+      const std::uint64_t* w = words_ + e.firstHit;
+      const std::size_t first = hits.size();
+      hits.resize(first + e.numHits);
+      for(std::uint32_t k = 0; k < e.numHits; ++k) {
+        hits[first + k] = unpack(w[k]);
+      }
+    }
+
+  } // namespace ExtRawHitStream
+} // namespace mu2e
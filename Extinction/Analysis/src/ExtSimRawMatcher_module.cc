@@ -0,0 +1,305 @@
+// Truth matching of ExtMonFNAL raw hits to sim hits, for validating the
+// digitization in one pass instead of joining the emfdrawsim and
+// emfdrawraw ntuples offline.
+//
+// Each sim hit is mapped to the pixels under its local start to end
+// segment, projected on the sensor and sampled every half of the finer
+// pitch.  The sampled positions are mapped to pixels by the pixel-ID
+// converter of the ExtMonFNAL geometry, the one the digitization uses,
+// through an ExtMonPixelGeometry built at beginRun.  A per event hash
+// index from the pixel (module, chip, col, row) to the sim hits on it is
+// then probed by every raw hit.  Hit times are not compared.
+//
+//   efficiency: sim hits above minEnergy with a raw hit on one of their pixels
+//   purity:     raw hits on a pixel of a sim hit
+//   cluster size, per number n of
+//     - pixels under a sim hit above minEnergy ("sim"),
+//     - matched raw hits of the same SimParticle on a module ("truth"),
+//       a raw hit on several sim hits going to the largest deposit,
+//     - hits of the clustersInputTag clusters, when given ("reco").
+//
+// The tables are logged at endJob and written as histograms, the per
+// plane counts with one bin per plane.
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "cetlib_except/exception.h"
+
+#include "TH1D.h"
+
+#include "canvas/Utilities/InputTag.h"
+#include "art/Framework/Core/EDAnalyzer.h"
+#include "fhiclcpp/types/Atom.h"
+#include "fhiclcpp/types/OptionalAtom.h"
+#include "art/Framework/Principal/Event.h"
+#include "art/Framework/Principal/Handle.h"
+#include "art/Framework/Principal/Run.h"
+#include "art_root_io/TFileService.h"
+#include "messagefacility/MessageLogger/MessageLogger.h"
+
+#include "Offline/GeometryService/inc/GeomHandle.hh"
+#include "Offline/ExtinctionMonitorFNAL/Geometry/inc/ExtMonFNAL.hh"
+#include "Offline/MCDataProducts/inc/ExtMonFNALSimHit.hh"
+#include "Offline/RecoDataProducts/inc/ExtMonFNALRawHit.hh"
+#include "Offline/RecoDataProducts/inc/ExtMonFNALRawCluster.hh"
+
+#include "Extinction/Analysis/inc/ExtMonPixelGeometry.hh"
+#include "Extinction/Analysis/inc/ExtMonPixelKey.hh"
+
+
+namespace mu2e {
+
+  //================================================================
+  class ExtSimRawMatcher : public art::EDAnalyzer {
+    struct Config {
+      using Name=fhicl::Name;
+      using Comment=fhicl::Comment;
+      fhicl::Atom<std::string> simHits  {Name("simHitsInputTag"  ), Comment("ExtMonFNALSimHit collection")};
+      fhicl::Atom<std::string> rawHits  {Name("rawHitsInputTag"  ), Comment("ExtMonFNALRawHit collection")};
+      fhicl::OptionalAtom<std::string> clusters{Name("clustersInputTag"), Comment("ExtMonFNALRawCluster collection for the reco cluster sizes")};
+      fhicl::Atom<double> minEnergy{Name("minEnergy"), Comment("Smallest deposit of a sim hit counted for the efficiency, MeV"), 0.};
+      fhicl::Atom<unsigned> maxPlanes{Name("maxPlanes"), Comment("Planes in the per plane tables"), 8};
+      fhicl::Atom<unsigned> maxClusterSize{Name("maxClusterSize"), Comment("Last, overflow, row of the cluster size table"), 20};
+    };
+
+    typedef art::EDAnalyzer::Table<Config> Parameters;
+
+  protected:
+
+    art::InputTag simHitsInputTag_;
+    art::InputTag rawHitsInputTag_;
+    art::InputTag clustersInputTag_;
+    bool useClusters_;
+    ExtMonPixelGeometry geom_;      // from the ExtMonFNAL geometry at beginRun
+    double step_;
+    double minEnergy_;
+    unsigned maxPlanes_;
+    unsigned maxClusterSize_;
+
+    // Per event work space, kept to reuse the buckets and capacity
+    std::unordered_multimap<std::uint64_t, std::uint32_t> simIndex_; // pixel key to sim hit
+    std::unordered_set<std::uint64_t> rawPixels_;
+    std::unordered_map<std::uint64_t, unsigned> truthClusters_;      // (particle, module) to raw hits
+    std::vector<std::uint64_t> simPixels_;                           // pixels of all sim hits
+    std::vector<std::uint32_t> simFirst_;                            // first pixel of sim hit i in simPixels_
+
+    // Tables, by plane or by size
+    std::vector<unsigned long> simHits_;
+    std::vector<unsigned long> simHitsFound_;
+    std::vector<unsigned long> rawHits_;
+    std::vector<unsigned long> rawHitsMatched_;
+    std::vector<unsigned long> simSize_;
+    std::vector<unsigned long> truthSize_;
+    std::vector<unsigned long> recoSize_;
+    unsigned long numEvents_;
+
+    static std::uint64_t pixelKey(const ExtMonFNALPixelId& pix) {
+      return (std::uint64_t(ExtMonPixelKey::chip(pix.chip())) << 20) | (std::uint64_t(pix.col()) << 10) | pix.row();
+    }
+
+    unsigned planeBin(unsigned plane) const { return std::min(plane, maxPlanes_); }
+    unsigned sizeBin(unsigned n) const { return std::min(n, maxClusterSize_); }
+
+    void mapSimHit(const ExtMonFNALSimHit& hit);
+    void writeHistogram(const char* name, const char* title, const std::vector<unsigned long>& counts) const;
+
+    public:
+    explicit ExtSimRawMatcher(const Parameters& pset);
+    virtual void beginRun(const art::Run& run);
+    virtual void analyze(const art::Event& event);
+    virtual void endJob();
+  };
+
+  //================================================================
+  ExtSimRawMatcher::ExtSimRawMatcher(const Parameters& pset)
+    : art::EDAnalyzer(pset)
+      , simHitsInputTag_(pset().simHits())
+      , rawHitsInputTag_(pset().rawHits())
+      , useClusters_(false)
+      , step_(0)
+      , minEnergy_(pset().minEnergy())
+      , maxPlanes_(pset().maxPlanes())
+      , maxClusterSize_(pset().maxClusterSize())
+      , numEvents_(0)
+  {
+    std::string clusters;
+    if(pset().clusters(clusters)) {
+      clustersInputTag_ = art::InputTag(clusters);
+      useClusters_ = true;
+    }
+    if(maxPlanes_ == 0 || maxClusterSize_ == 0) {
+      throw cet::exception("BADCONFIG")<<"ExtSimRawMatcher: maxPlanes and maxClusterSize must be positive\n";
+    }
+
+    // The last bin of each table collects the overflow
+    simHits_.assign(maxPlanes_ + 1, 0);
+    simHitsFound_.assign(maxPlanes_ + 1, 0);
+    rawHits_.assign(maxPlanes_ + 1, 0);
+    rawHitsMatched_.assign(maxPlanes_ + 1, 0);
+    simSize_.assign(maxClusterSize_ + 1, 0);
+    truthSize_.assign(maxClusterSize_ + 1, 0);
+    recoSize_.assign(maxClusterSize_ + 1, 0);
+  }
+
+  //================================================================
+  void ExtSimRawMatcher::beginRun(const art::Run&) {
+    GeomHandle<ExtMonFNAL::ExtMon> extmon;
+    geom_ = ExtMonPixelGeometry(*extmon);
+    step_ = 0.5*std::min(geom_.pitch(0), geom_.pitch(1));
+    if(!(step_ > 0.)) {
+      throw cet::exception("BADCONFIG")<<"ExtSimRawMatcher: the ExtMonFNAL geometry has no pixel pitch\n";
+    }
+  }
+
+  //================================================================
+  void ExtSimRawMatcher::mapSimHit(const ExtMonFNALSimHit& hit) {
+    const double u0 = hit.localStartPosition().x(), v0 = hit.localStartPosition().y();
+    const double du = hit.localEndPosition().x() - u0, dv = hit.localEndPosition().y() - v0;
+    const unsigned steps = std::min(10000., std::ceil(std::sqrt(du*du + dv*dv)/step_));
+
+    const std::size_t first = simPixels_.size();
+    ExtMonFNALPixelId pix;
+    for(unsigned s = 0; s <= steps; ++s) {
+      const double f = steps ? double(s)/steps : 0.;
+      if(geom_.pixel(hit.moduleId(), u0 + f*du, v0 + f*dv, pix)) {
+        const std::uint64_t key = pixelKey(pix);
+        if(std::find(simPixels_.begin() + first, simPixels_.end(), key) == simPixels_.end()) {
+          simPixels_.push_back(key);
+        }
+      }
+    }
+  }
+
+  //================================================================
+
+  void ExtSimRawMatcher::analyze(const art::Event& event) {
+
+    const auto& sh = event.getValidHandle<ExtMonFNALSimHitCollection>(simHitsInputTag_);
+    const auto& rh = event.getValidHandle<ExtMonFNALRawHitCollection>(rawHitsInputTag_);
+    const ExtMonFNALSimHitCollection& simHits(*sh);
+
+    simIndex_.clear();
+    rawPixels_.clear();
+    truthClusters_.clear();
+    simPixels_.clear();
+    simFirst_.resize(simHits.size() + 1);
+
+    for(std::uint32_t i = 0; i < simHits.size(); ++i) {
+      simFirst_[i] = simPixels_.size();
+      mapSimHit(simHits[i]);
+      for(std::size_t k = simFirst_[i]; k < simPixels_.size(); ++k) {
+        simIndex_.emplace(simPixels_[k], i);
+      }
+    }
+    simFirst_[simHits.size()] = simPixels_.size();
+
+    // Purity and truth clusters
+    for(const auto& hit : *rh) {
+      const std::uint64_t key = pixelKey(hit.pixelId());
+      const unsigned plane = planeBin(hit.pixelId().chip().module().plane());
+      rawPixels_.insert(key);
+      ++rawHits_[plane];
+
+      const auto range = simIndex_.equal_range(key);
+      if(range.first == range.second) continue;
+      ++rawHitsMatched_[plane];
+
+      const ExtMonFNALSimHit* best = nullptr;
+      for(auto it = range.first; it != range.second; ++it) {
+        const ExtMonFNALSimHit& s = simHits[it->second];
+        if(!best || s.totalEnergyDeposit() > best->totalEnergyDeposit()) best = &s;
+      }
+      const std::uint64_t truthKey = (std::uint64_t(best->simParticle()->id().asUint()) << 10)
+        | ExtMonPixelKey::module(best->moduleId());
+      ++truthClusters_[truthKey];
+    }
+    for(const auto& t : truthClusters_) {
+      ++truthSize_[sizeBin(t.second)];
+    }
+
+    // Efficiency and sim cluster sizes
+    for(std::uint32_t i = 0; i < simHits.size(); ++i) {
+      if(simHits[i].totalEnergyDeposit() < minEnergy_) continue;
+      const unsigned plane = planeBin(simHits[i].moduleId().plane());
+      ++simHits_[plane];
+      bool found = false;
+      for(std::size_t k = simFirst_[i]; k < simFirst_[i + 1] && !found; ++k) {
+        found = rawPixels_.count(simPixels_[k]);
+      }
+      simHitsFound_[plane] += found;
+      ++simSize_[sizeBin(simFirst_[i + 1] - simFirst_[i])];
+    }
+
+    if(useClusters_) {
+      const auto& ch = event.getValidHandle<ExtMonFNALRawClusterCollection>(clustersInputTag_);
+      for(const auto& cluster : *ch) {
+        ++recoSize_[sizeBin(cluster.hits().size())];
+      }
+    }
+
+    ++numEvents_;
+  }
+
+  //================================================================
+  void ExtSimRawMatcher::writeHistogram(const char* name, const char* title, const std::vector<unsigned long>& counts) const {
+    art::ServiceHandle<art::TFileService> tfs;
+    TH1D* h = tfs->make<TH1D>(name, title, counts.size(), -0.5, counts.size() - 0.5);
+    double entries = 0;
+    for(std::size_t i = 0; i < counts.size(); ++i) {
+      h->SetBinContent(i + 1, counts[i]);
+      entries += counts[i];
+    }
+    h->SetEntries(entries);
+  }
+
+  //================================================================
+
+  void ExtSimRawMatcher::endJob() {
+    writeHistogram("simHits", "Sim hits;plane;sim hits", simHits_);
+    writeHistogram("simHitsFound", "Sim hits with a raw hit;plane;sim hits", simHitsFound_);
+    writeHistogram("rawHits", "Raw hits;plane;raw hits", rawHits_);
+    writeHistogram("rawHitsMatched", "Raw hits on a sim hit pixel;plane;raw hits", rawHitsMatched_);
+    writeHistogram("simClusterSize", "Pixels under a sim hit;pixels;sim hits", simSize_);
+    writeHistogram("truthClusterSize", "Raw hits per SimParticle and module;raw hits;clusters", truthSize_);
+    if(useClusters_) {
+      writeHistogram("recoClusterSize", "Raw hits per cluster;raw hits;clusters", recoSize_);
+    }
+
+    std::ostringstream os;
+    os<<"ExtSimRawMatcher: "<<numEvents_<<" events\n";
+    os<<std::setw(6)<<"plane"<<std::setw(12)<<"simHits"<<std::setw(12)<<"found"<<std::setw(12)<<"efficiency"
+      <<std::setw(12)<<"rawHits"<<std::setw(12)<<"matched"<<std::setw(12)<<"purity"<<"\n";
+    for(unsigned p = 0; p <= maxPlanes_; ++p) {
+      if(simHits_[p] == 0 && rawHits_[p] == 0) continue;
+      os<<std::setw(6)<<(p < maxPlanes_ ? std::to_string(p) : ">="+std::to_string(p))
+        <<std::setw(12)<<simHits_[p]<<std::setw(12)<<simHitsFound_[p]
+        <<std::setw(12)<<(simHits_[p] ? double(simHitsFound_[p])/simHits_[p] : 0.)
+        <<std::setw(12)<<rawHits_[p]<<std::setw(12)<<rawHitsMatched_[p]
+        <<std::setw(12)<<(rawHits_[p] ? double(rawHitsMatched_[p])/rawHits_[p] : 0.)<<"\n";
+    }
+    os<<std::setw(6)<<"size"<<std::setw(12)<<"sim"<<std::setw(12)<<"truth";
+    if(useClusters_) os<<std::setw(12)<<"reco";
+    os<<"\n";
+    for(unsigned n = 0; n <= maxClusterSize_; ++n) {
+      if(simSize_[n] == 0 && truthSize_[n] == 0 && recoSize_[n] == 0) continue;
+      os<<std::setw(6)<<(n < maxClusterSize_ ? std::to_string(n) : ">="+std::to_string(n))
+        <<std::setw(12)<<simSize_[n]<<std::setw(12)<<truthSize_[n];
+      if(useClusters_) os<<std::setw(12)<<recoSize_[n];
+      os<<"\n";
+    }
+    mf::LogInfo("Summary")<<os.str();
+  }
+
+  //================================================================
+
+} // namespace mu2e
+
+DEFINE_ART_MODULE(mu2e::ExtSimRawMatcher)
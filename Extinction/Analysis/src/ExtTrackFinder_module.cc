@@ -0,0 +1,456 @@
+// Straight line track finder for the ExtMonFNAL planes.
+//
+// The clusters of ExtRawHitClusterer are placed in space with
+// ExtMonPixelGeometry at their clusterCentroid(), as in the
+// ExtRawHitClusterer ntuple, and grouped into frames of frameClocks
+// consecutive clocks.  In each frame every cluster of the
+// first seed plane is paired with the clusters of the second seed plane
+// within maxSlope, looked up in a uniform grid hash of that plane.  Each
+// seed line picks up the nearest free cluster within roadWidth on the
+// other planes, again through per-plane grid hashes, and the candidate is
+// fitted with closed form least squares in x(z) and y(z).  The best
+// candidate of a first-plane cluster (most clusters, then lowest chi2) is
+// kept if it has minHits clusters and chi2/ndf below maxChi2, and its
+// clusters are not reused.
+//
+// One row per track goes to the "nt" tree, and the track clocks to the
+// "trackClock" histogram.  The module placements and pixel positions
+// come from the ExtMonFNAL geometry at each beginRun; tracks are found in
+// the planes of one plane stack, in that stack's frame.  With
+// applyPixelMask the cluster hits masked by
+// ExtMonFNALPixelMask are ignored.
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <sstream>
+
+#include "cetlib_except/exception.h"
+
+#include "TH1D.h"
+#include "TTree.h"
+
+#include "canvas/Utilities/InputTag.h"
+#include "art/Framework/Core/EDAnalyzer.h"
+#include "fhiclcpp/types/Atom.h"
+#include "fhiclcpp/types/OptionalSequence.h"
+#include "fhiclcpp/types/Sequence.h"
+#include "fhiclcpp/types/Table.h"
+#include "art/Framework/Principal/Event.h"
+#include "art/Framework/Principal/Handle.h"
+#include "art/Framework/Principal/Run.h"
+#include "art_root_io/TFileService.h"
+#include "messagefacility/MessageLogger/MessageLogger.h"
+
+#include "Offline/GeometryService/inc/GeomHandle.hh"
+#include "Offline/ExtinctionMonitorFNAL/Geometry/inc/ExtMonFNAL.hh"
+#include "Offline/RecoDataProducts/inc/ExtMonFNALRawHit.hh"
+#include "Offline/RecoDataProducts/inc/ExtMonFNALRawCluster.hh"
+
+#include "Extinction/Analysis/inc/ExtMonClusterCentroid.hh"
+#include "Extinction/Analysis/inc/ExtMonFNALPixelMask.hh"
+#include "Extinction/Analysis/inc/ExtMonPixelGeometry.hh"
+#include "Extinction/Analysis/inc/RadixSort.hh"
+
+
+namespace mu2e {
+
+  //================================================================
+
+  struct ExtTrack {
+
+          int RunID;
+          int SubRunID;
+          long long EventID;
+          int clock;
+          unsigned int nHits;
+          double z0;
+          double x0;
+          double y0;
+          double tx;
+          double ty;
+          double chi2ndf;
+
+    ExtTrack() :  RunID(-1), SubRunID(-1), EventID(-1),
+                  clock(0), nHits(0),
+                  z0(0), x0(0), y0(0), tx(0), ty(0), chi2ndf(0)
+                {}
+
+  }; // struct ExtTrack
+
+  //================================================================
+  class ExtTrackFinder : public art::EDAnalyzer {
+    struct Config {
+      using Name=fhicl::Name;
+      using Comment=fhicl::Comment;
+      fhicl::Atom<std::string> clusters {Name("clustersInputTag"), Comment("ExtMonFNALRawCluster collection")};
+      fhicl::Atom<std::string> stack{Name("stack"), Comment("Plane stack of the ExtMonFNAL geometry to find tracks in, dn or up")};
+      fhicl::Atom<unsigned> frameClocks{Name("frameClocks"), Comment("Clocks per readout frame"), 1};
+      fhicl::OptionalSequence<unsigned,2> seedPlanes{Name("seedPlanes"),
+          Comment("The two seed planes of the stack, by default the first and last in z")};
+      fhicl::Atom<double> maxSlope{Name("maxSlope"), Comment("Largest |dx/dz| and |dy/dz| of a seed"), 0.05};
+      fhicl::Atom<double> roadWidth{Name("roadWidth"), Comment("Largest distance of a cluster from the seed line, mm"), 0.5};
+      fhicl::Atom<double> resolution{Name("resolution"), Comment("Cluster position resolution used in chi2, mm"), 0.05};
+      fhicl::Atom<unsigned> minHits{Name("minHits"), Comment("Smallest number of clusters on a track"), 4};
+      fhicl::Atom<double> maxChi2{Name("maxChi2"), Comment("Largest chi2/ndf of a track"), 10.};
+      fhicl::Atom<bool> applyPixelMask{Name("applyPixelMask"), Comment("Skip hits masked by the ExtMonFNALPixelMask service"), false};
+    };
+
+    typedef art::EDAnalyzer::Table<Config> Parameters;
+
+    struct Point {
+      double x, y, z;
+      int clock;
+      unsigned plane; // index into planes_
+      bool used;
+    };
+
+    // Uniform grid hash of the points of one plane, sorted by cell key
+    struct PlaneHash {
+      double cell = 1.;
+      std::vector<std::uint64_t> keys;
+      std::vector<std::uint32_t> order;
+      std::vector<std::uint64_t> sortedKeys;
+      std::vector<std::uint32_t> points;
+
+      static std::uint64_t key(long ix, long iy) {
+        return (std::uint64_t(std::uint32_t(ix)) << 32) | std::uint32_t(iy);
+      }
+      long index(double v) const { return long(std::floor(v/cell)); }
+    };
+
+    struct Fit {
+      double x0, y0, tx, ty, chi2;
+    };
+
+  protected:
+
+    art::InputTag clustersInputTag_;
+    ExtMonPixelGeometry::Stack stack_;
+    bool hasSeedPlanes_;
+    std::array<unsigned,2> seedPlanes_;
+    ExtMonPixelGeometry geom_;      // from the ExtMonFNAL geometry at beginRun
+    int frameClocks_;
+    double maxSlope_;
+    double roadWidth_;
+    double resolution_;
+    unsigned minHits_;
+    double maxChi2_;
+    const ExtMonFNALPixelMask* mask_;
+
+    std::vector<unsigned> planes_;    // plane numbers of the stack in increasing z
+    std::vector<int> planeIndex_;     // plane number to index into planes_
+    unsigned seedA_;
+    unsigned seedB_;
+    double z0_;
+
+    TTree *nt_;
+    TH1D *hClock_;
+    ExtTrack track_;
+
+    // Per event work arrays, kept to reuse their capacity
+    std::vector<Point> points_;
+    std::vector<std::uint64_t> clockKeys_;
+    std::vector<std::uint32_t> clockOrder_;
+    std::vector<Point> frame_;
+    std::vector<PlaneHash> hashes_;
+    std::vector<std::uint32_t> candidate_;
+    std::vector<std::uint32_t> best_;
+
+    unsigned long numEvents_;
+    unsigned long numFrames_;
+    unsigned long numClusters_;
+    unsigned long numTracks_;
+
+    void buildHash(unsigned plane);
+    template<class F> void query(unsigned plane, double x, double y, F f) const;
+    Fit fit(const std::vector<std::uint32_t>& hits) const;
+    void processFrame(const art::Event& event);
+
+    public:
+    explicit ExtTrackFinder(const Parameters& pset);
+    virtual void beginJob();
+    virtual void beginRun(const art::Run& run);
+    virtual void analyze(const art::Event& event);
+    virtual void endJob();
+  };
+
+  //================================================================
+  ExtTrackFinder::ExtTrackFinder(const Parameters& pset)
+    : art::EDAnalyzer(pset)
+      , clustersInputTag_(pset().clusters())
+      , stack_(pset().stack() == "dn" ? ExtMonPixelGeometry::dn : ExtMonPixelGeometry::up)
+      , hasSeedPlanes_(false)
+      , seedPlanes_{{0, 0}}
+      , frameClocks_(pset().frameClocks())
+      , maxSlope_(pset().maxSlope())
+      , roadWidth_(pset().roadWidth())
+      , resolution_(pset().resolution())
+      , minHits_(pset().minHits())
+      , maxChi2_(pset().maxChi2())
+      , mask_(pset().applyPixelMask() ? &*art::ServiceHandle<ExtMonFNALPixelMask>() : nullptr)
+      , seedA_(0)
+      , seedB_(0)
+      , z0_(0)
+      , nt_(0)
+      , hClock_(0)
+      , numEvents_(0)
+      , numFrames_(0)
+      , numClusters_(0)
+      , numTracks_(0)
+  {
+    if(frameClocks_ < 1 || minHits_ < 3 || !(roadWidth_ > 0.) || !(resolution_ > 0.)) {
+      throw cet::exception("BADCONFIG")<<"ExtTrackFinder: need frameClocks >= 1, minHits >= 3,"
+                                       <<" positive roadWidth and resolution\n";
+    }
+    if(pset().stack() != "dn" && pset().stack() != "up") {
+      throw cet::exception("BADCONFIG")<<"ExtTrackFinder: unknown stack \""<<pset().stack()<<"\", expect dn or up\n";
+    }
+    hasSeedPlanes_ = pset().seedPlanes(seedPlanes_);
+  }
+
+  //================================================================
+  void ExtTrackFinder::beginRun(const art::Run&) {
+    GeomHandle<ExtMonFNAL::ExtMon> extmon;
+    geom_ = ExtMonPixelGeometry(*extmon);
+    planes_ = geom_.planes(stack_);
+    if(planes_.size() < 2) {
+      throw cet::exception("BADCONFIG")<<"ExtTrackFinder: the "<<(stack_ == ExtMonPixelGeometry::dn ? "dn" : "up")
+                                       <<" stack needs at least two planes\n";
+    }
+
+    planeIndex_.assign(*std::max_element(planes_.begin(), planes_.end()) + 1, -1);
+    for(unsigned i = 0; i < planes_.size(); ++i) {
+      planeIndex_[planes_[i]] = i;
+    }
+
+    seedA_ = 0;
+    seedB_ = planes_.size() - 1;
+    if(hasSeedPlanes_) {
+      for(unsigned i = 0; i < 2; ++i) {
+        if(seedPlanes_[i] >= planeIndex_.size() || planeIndex_[seedPlanes_[i]] < 0) {
+          throw cet::exception("BADCONFIG")<<"ExtTrackFinder: seed plane "<<seedPlanes_[i]<<" is not in the stack\n";
+        }
+      }
+      seedA_ = planeIndex_[seedPlanes_[0]];
+      seedB_ = planeIndex_[seedPlanes_[1]];
+      if(seedA_ == seedB_) {
+        throw cet::exception("BADCONFIG")<<"ExtTrackFinder: the seed planes must differ\n";
+      }
+    }
+    z0_ = geom_.planeZ(planes_[seedA_]);
+
+    hashes_.resize(planes_.size());
+    for(unsigned i = 0; i < planes_.size(); ++i) {
+      // The seed plane B cell covers the slope window, the others the road
+      hashes_[i].cell = (i == seedB_)
+        ? std::max(roadWidth_, maxSlope_*std::abs(geom_.planeZ(planes_[seedB_]) - z0_) + roadWidth_)
+        : roadWidth_;
+    }
+  }
+
+  //================================================================
+  void ExtTrackFinder::beginJob() {
+    art::ServiceHandle<art::TFileService> tfs;
+    static const char branchDesc[] = "RunID/I:SubRunID/I:EventID/L:clock/I:nHits/i:z0/D:x0/D:y0/D:tx/D:ty/D:chi2ndf/D";
+    nt_ = tfs->make<TTree>( "nt", "ExtTracks ntuple");
+    nt_->Branch("tracks", &track_, branchDesc);
+    hClock_ = tfs->make<TH1D>("trackClock", "Track clock", 4096, -0.5, 4095.5);
+  }
+
+  //================================================================
+  void ExtTrackFinder::buildHash(unsigned plane) {
+    PlaneHash& h = hashes_[plane];
+    h.keys.clear();
+    h.points.clear();
+    for(std::uint32_t i = 0; i < frame_.size(); ++i) {
+      if(frame_[i].plane == plane) {
+        h.keys.push_back(PlaneHash::key(h.index(frame_[i].x), h.index(frame_[i].y)));
+        h.points.push_back(i);
+      }
+    }
+    radixSortIndices(h.keys, h.order);
+    h.sortedKeys.resize(h.keys.size());
+    std::vector<std::uint32_t> sortedPoints(h.points.size());
+    for(std::size_t i = 0; i < h.order.size(); ++i) {
+      h.sortedKeys[i] = h.keys[h.order[i]];
+      sortedPoints[i] = h.points[h.order[i]];
+    }
+    h.points.swap(sortedPoints);
+  }
+
+  // Calls f(point) for the points of the plane in the 3x3 cells around (x, y)
+  template<class F> void ExtTrackFinder::query(unsigned plane, double x, double y, F f) const {
+    const PlaneHash& h = hashes_[plane];
+    const long ix = h.index(x), iy = h.index(y);
+    for(long dx = -1; dx <= 1; ++dx) {
+      for(long dy = -1; dy <= 1; ++dy) {
+        const auto range = std::equal_range(h.sortedKeys.begin(), h.sortedKeys.end(), PlaneHash::key(ix + dx, iy + dy));
+        for(auto it = range.first; it != range.second; ++it) {
+          f(h.points[it - h.sortedKeys.begin()]);
+        }
+      }
+    }
+  }
+
+  //================================================================
+  ExtTrackFinder::Fit ExtTrackFinder::fit(const std::vector<std::uint32_t>& hits) const {
+    double s0 = 0, sz = 0, szz = 0, sx = 0, sxz = 0, sy = 0, syz = 0;
+    for(std::uint32_t i : hits) {
+      const Point& p = frame_[i];
+      const double z = p.z - z0_;
+      s0 += 1; sz += z; szz += z*z;
+      sx += p.x; sxz += p.x*z;
+      sy += p.y; syz += p.y*z;
+    }
+    const double det = s0*szz - sz*sz;
+    Fit f;
+    f.tx = (s0*sxz - sz*sx)/det;
+    f.x0 = (sx*szz - sz*sxz)/det;
+    f.ty = (s0*syz - sz*sy)/det;
+    f.y0 = (sy*szz - sz*syz)/det;
+    f.chi2 = 0;
+    for(std::uint32_t i : hits) {
+      const Point& p = frame_[i];
+      const double z = p.z - z0_;
+      const double rx = p.x - f.x0 - f.tx*z, ry = p.y - f.y0 - f.ty*z;
+      f.chi2 += rx*rx + ry*ry;
+    }
+    f.chi2 /= resolution_*resolution_;
+    return f;
+  }
+
+  //================================================================
+  void ExtTrackFinder::processFrame(const art::Event& event) {
+    ++numFrames_;
+    for(unsigned p = 0; p < planes_.size(); ++p) {
+      buildHash(p);
+    }
+
+    const double zB = geom_.planeZ(planes_[seedB_]) - z0_;
+    const double window = maxSlope_*std::abs(zB) + roadWidth_;
+    const unsigned ndfFactor = 2;
+
+    for(std::uint32_t a : hashes_[seedA_].points) {
+      if(frame_[a].used) continue;
+      const Point& pa = frame_[a];
+
+      best_.clear();
+      Fit bestFit{0, 0, 0, 0, 0};
+      query(seedB_, pa.x, pa.y, [&](std::uint32_t b) {
+          const Point& pb = frame_[b];
+          if(pb.used || std::abs(pb.x - pa.x) > window || std::abs(pb.y - pa.y) > window) return;
+
+          const double tx = (pb.x - pa.x)/zB, ty = (pb.y - pa.y)/zB;
+          candidate_.assign({a, b});
+          for(unsigned p = 0; p < planes_.size(); ++p) {
+            if(p == seedA_ || p == seedB_) continue;
+            const double z = geom_.planeZ(planes_[p]) - z0_;
+            const double x = pa.x + tx*z, y = pa.y + ty*z;
+            double bestD2 = roadWidth_*roadWidth_;
+            std::int64_t nearest = -1;
+            query(p, x, y, [&](std::uint32_t c) {
+                if(frame_[c].used) return;
+                const double d2 = (frame_[c].x - x)*(frame_[c].x - x) + (frame_[c].y - y)*(frame_[c].y - y);
+                if(d2 <= bestD2) { bestD2 = d2; nearest = c; }
+              });
+            if(nearest >= 0) candidate_.push_back(nearest);
+          }
+          if(candidate_.size() < minHits_ || candidate_.size() < best_.size()) return;
+
+          const Fit f = fit(candidate_);
+          const double ndf = ndfFactor*candidate_.size() - 4;
+          if(f.chi2/ndf > maxChi2_) return;
+          if(candidate_.size() > best_.size() || f.chi2 < bestFit.chi2) {
+            best_ = candidate_;
+            bestFit = f;
+          }
+        });
+
+      if(best_.empty()) continue;
+
+      for(std::uint32_t i : best_) frame_[i].used = true;
+      track_ = ExtTrack();
+      track_.RunID = event.run();
+      track_.SubRunID = event.subRun();
+      track_.EventID = event.event();
+      track_.clock = pa.clock;
+      track_.nHits = best_.size();
+      track_.z0 = z0_;
+      track_.x0 = bestFit.x0;
+      track_.y0 = bestFit.y0;
+      track_.tx = bestFit.tx;
+      track_.ty = bestFit.ty;
+      track_.chi2ndf = bestFit.chi2/(ndfFactor*best_.size() - 4);
+      nt_->Fill();
+      hClock_->Fill(pa.clock);
+      ++numTracks_;
+    }
+  }
+
+  //================================================================
+
+  void ExtTrackFinder::analyze(const art::Event& event) {
+
+    if(mask_) mask_->checkLearner("ExtTrackFinder");
+
+    const auto& ih = event.getValidHandle<ExtMonFNALRawClusterCollection>(clustersInputTag_);
+    ++numEvents_;
+
+    points_.clear();
+    for(const auto& cluster : *ih) {
+      const auto& hits = cluster.hits();
+      if(hits.empty()) continue;
+      const ExtMonFNALChipId& chip = hits.front()->pixelId().chip();
+      const unsigned plane = chip.module().plane();
+      if(plane >= planeIndex_.size() || planeIndex_[plane] < 0 || !geom_.hasModule(chip.module())) continue;
+
+      const auto masked = [this](const ExtMonFNALRawHit& h) { return mask_ && mask_->masked(h.pixelId()); };
+      double col = 0, row = 0;
+      if(!clusterCentroid(hits, masked, col, row)) continue; // all hits masked
+      int clock = std::numeric_limits<int>::max();
+      for(const auto& h : hits) {
+        if(!masked(*h)) clock = std::min(clock, h->clock());
+      }
+      const CLHEP::Hep3Vector pos = geom_.position(chip, col, row);
+      points_.push_back(Point{pos.x(), pos.y(), pos.z(), clock, unsigned(planeIndex_[plane]), false});
+    }
+    numClusters_ += points_.size();
+
+    clockKeys_.resize(points_.size());
+    for(std::size_t i = 0; i < points_.size(); ++i) {
+      clockKeys_[i] = radixKey(points_[i].clock);
+    }
+    radixSortIndices(clockKeys_, clockOrder_);
+
+    for(std::size_t begin = 0; begin < clockOrder_.size(); ) {
+      const int first = points_[clockOrder_[begin]].clock;
+      std::size_t end = begin;
+      frame_.clear();
+      while(end < clockOrder_.size() && points_[clockOrder_[end]].clock - first < frameClocks_) {
+        frame_.push_back(points_[clockOrder_[end]]);
+        ++end;
+      }
+      processFrame(event);
+      begin = end;
+    }
+  }
+
+  //================================================================
+
+  void ExtTrackFinder::endJob() {
+    std::ostringstream os;
+    os<<"ExtTrackFinder: "<<numTracks_<<" tracks from "<<numClusters_<<" clusters in "
+      <<numFrames_<<" frames of "<<numEvents_<<" events";
+    mf::LogInfo("Summary")<<os.str();
+  }
+
+  //================================================================
+
+} // namespace mu2e
+
+DEFINE_ART_MODULE(mu2e::ExtTrackFinder)
@@ -0,0 +1,117 @@
+#ifndef PionProduction_PairCountMap_hh
+#define PionProduction_PairCountMap_hh
+//
+// Sparse count matrix over pairs of int codes, e.g. (ParentPID, ParticlePID)
+// or (StartVolumeID, EndVolumeID), accumulated over a whole job.
+//
+// Open addressing with linear probing in a power of two table kept at most
+// half full; a slot is empty while its count is zero, so no key value is
+// reserved.  An increment is one hash and, almost always, one cache line.
+//
+
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace art { class TFileDirectory; }
+
+namespace mu2e {
+
+  class PairCountMap {
+  public:
+    typedef std::tuple<int, int, unsigned long> Entry;
+
+    explicit PairCountMap(unsigned initialCapacity = 1024) {
+      unsigned n = 16;
+      while(n < initialCapacity) n *= 2;
+      slots_.resize(n);
+    }
+
+    void increment(int a, int b, unsigned long count = 1) {
+      if(2*(size_ + 1) > slots_.size()) {
+        grow();
+      }
+      const std::uint64_t key = pack(a, b);
+      Slot& s = find(key);
+      if(s.count == 0) {
+        s.key = key;
+        ++size_;
+      }
+      s.count += count;
+    }
+
+    unsigned long count(int a, int b) const {
+      const std::uint64_t key = pack(a, b);
+      const std::size_t mask = slots_.size() - 1;
+      for(std::size_t i = hash(key) & mask; slots_[i].count != 0; i = (i + 1) & mask) {
+        if(slots_[i].key == key) {
+          return slots_[i].count;
+        }
+      }
+      return 0;
+    }
+
+    // Number of non-zero cells
+    std::size_t size() const { return size_; }
+    unsigned long total() const {
+      unsigned long sum = 0;
+      for(const auto& s : slots_) sum += s.count;
+      return sum;
+    }
+
+    // Non-zero cells sorted by (a, b)
+    std::vector<Entry> entries() const;
+
+  private:
+    struct Slot {
+      std::uint64_t key = 0;
+      unsigned long count = 0;
+    };
+
+    std::vector<Slot> slots_;
+    std::size_t size_ = 0;
+
+    static std::uint64_t pack(int a, int b) {
+      return (std::uint64_t(std::uint32_t(a)) << 32) | std::uint32_t(b);
+    }
+
+    static std::uint64_t hash(std::uint64_t x) {
+      // splitmix64 finalizer
+      x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+      x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+      x ^= x >> 31;
+      return x;
+    }
+
+    Slot& find(std::uint64_t key) {
+      const std::size_t mask = slots_.size() - 1;
+      std::size_t i = hash(key) & mask;
+      while(slots_[i].count != 0 && slots_[i].key != key) {
+        i = (i + 1) & mask;
+      }
+      return slots_[i];
+    }
+
+    void grow() {
+      std::vector<Slot> old(2*slots_.size());
+      old.swap(slots_);
+      for(const auto& s : old) {
+        if(s.count != 0) {
+          find(s.key) = s;
+        }
+      }
+    }
+  };
+
+  // Writes the non-zero cells to a TTree "<name>" with leaves
+  // "<aName>/I:<bName>/I:Count/l", and, when both axes have at most maxBins
+  // distinct values, a TH2D "h_<name>" with the codes as bin labels.
+  void writePairCounts(const PairCountMap& counts, art::TFileDirectory& dir,
+                       const std::string& name, const std::string& title,
+                       const std::string& aName, const std::string& bName,
+                       unsigned maxBins);
+
+} // namespace mu2e
+
+#endif/*PionProduction_PairCountMap_hh*/
@@ -0,0 +1,74 @@
+#ifndef PionProduction_RegionGrid_hh
+#define PionProduction_RegionGrid_hh
+//
+// Point location among a list of axis-aligned boxes.
+//
+// The bounding box of all regions is divided into a uniform grid; every
+// cell stores, in compressed row form, the regions overlapping it in the
+// order they were given.  A lookup computes the cell of the point and
+// tests only its candidates, usually one or two boxes, so the cost does
+// not grow with the number of regions.  Where regions overlap the first
+// one listed wins.
+//
+
+#include <vector>
+
+namespace mu2e {
+
+  class RegionGrid {
+  public:
+    struct Box {
+      double low[3];
+      double high[3];
+    };
+
+    RegionGrid() = default;
+
+    // divisions is the number of cells per axis, 0 to choose it from the
+    // number of regions
+    explicit RegionGrid(const std::vector<Box>& regions, unsigned divisions = 0);
+
+    // Index into the regions vector, -1 if the point is in none
+    int find(double x, double y, double z) const {
+      if(regions_.empty()) {
+        return -1;
+      }
+      const double p[3] = {x, y, z};
+      unsigned c[3];
+      for(int i=0; i<3; ++i) {
+        if(!(low_[i] <= p[i] && p[i] <= high_[i])) {  // also rejects NaN
+          return -1;
+        }
+        const unsigned u = unsigned((p[i] - low_[i])*invCell_[i]);
+        c[i] = (u < n_[i]) ? u : n_[i] - 1;
+      }
+      const unsigned cell = (c[2]*n_[1] + c[1])*n_[0] + c[0];
+      for(unsigned k = cellStart_[cell]; k < cellStart_[cell+1]; ++k) {
+        const Box& b = regions_[cellRegions_[k]];
+        if(b.low[0] <= x && x <= b.high[0] &&
+           b.low[1] <= y && y <= b.high[1] &&
+           b.low[2] <= z && z <= b.high[2]) {
+          return cellRegions_[k];
+        }
+      }
+      return -1;
+    }
+
+    unsigned size() const { return regions_.size(); }
+    unsigned cells() const { return n_[0]*n_[1]*n_[2]; }
+    // Average number of candidates per cell, for diagnostics
+    double meanCandidates() const { return cells() ? double(cellRegions_.size())/cells() : 0.; }
+
+  private:
+    std::vector<Box> regions_;
+    double low_[3] = {0., 0., 0.};
+    double high_[3] = {0., 0., 0.};
+    double invCell_[3] = {0., 0., 0.};
+    unsigned n_[3] = {0, 0, 0};
+    std::vector<unsigned> cellStart_;
+    std::vector<int> cellRegions_;
+  };
+
+} // namespace mu2e
+
+#endif/*PionProduction_RegionGrid_hh*/
@@ -0,0 +1,87 @@
+#ifndef PionProduction_SimParticleAncestry_hh
+#define PionProduction_SimParticleAncestry_hh
+//
+// Per-event export of the full SimParticle ancestry of selected particles.
+//
+// Every particle met while walking the chains is written once per event to
+// a node table (Node_* branches) that stores the row index of its parent,
+// -1 for a primary or when the parent was not kept.  The chain of selected
+// particle i is the list of node rows
+//
+//   Chain_Node[Chain_Offset[i]] ... Chain_Node[Chain_Offset[i+1]-1]
+//
+// starting from the particle itself and ending at the primary.  Modules
+// store the chain index i in an AncestryIndex column of their own ntuple.
+//
+// Parents in the same collection are found by key in the map_vector; an
+// art::Ptr is dereferenced only for parents from an earlier stage, and
+// each ancestor is visited once per event however many chains share it.
+//
+
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "canvas/Persistency/Provenance/ProductID.h"
+
+#include "Offline/MCDataProducts/inc/SimParticle.hh"
+
+class TTree;
+
+namespace mu2e {
+
+  class SimParticleAncestry {
+  public:
+
+    // Creates the tree with the node and chain branches, one entry per event
+    void book(TTree* tree);
+
+    void clear();
+
+    // Adds the chain of particle, which is an element of particles, and
+    // returns its chain index
+    int addChain(const art::ProductID& pid, const SimParticleCollection& particles, const SimParticle& particle);
+
+    unsigned nodes() const { return nodeParent_.size(); }
+    unsigned chains() const { return chainOffset_.size() - 1; }
+
+    // Fills one tree entry for the current event if it has chains
+    void fill(int runID, int subrunID, long long eventID);
+
+  private:
+    static std::uint64_t nodeKey(const art::ProductID& pid, unsigned key) {
+      return (std::uint64_t(pid.value()) << 32) | key;
+    }
+
+    int addNode(const SimParticle& particle, int parent);
+
+    TTree* tree_ = nullptr;
+    int runID_ = -1;
+    int subrunID_ = -1;
+    long long eventID_ = -1;
+
+    std::unordered_map<std::uint64_t, int> nodeIndex_;
+    std::vector<std::pair<const SimParticle*, std::uint64_t> > pending_;
+
+    // Node table
+    std::vector<unsigned> nodeKey_;
+    std::vector<int> nodeParent_;
+    std::vector<int> nodePdgId_;
+    std::vector<unsigned> nodeSimStage_;
+    std::vector<int> nodeCreationCode_;
+    std::vector<int> nodeStoppingCode_;
+    std::vector<float> nodeStartT_, nodeEndT_;
+    std::vector<float> nodeStartX_, nodeStartY_, nodeStartZ_;
+    std::vector<float> nodeEndX_, nodeEndY_, nodeEndZ_;
+    std::vector<float> nodeStartPx_, nodeStartPy_, nodeStartPz_;
+    std::vector<float> nodeEndPx_, nodeEndPy_, nodeEndPz_;
+
+    // Chains
+    std::vector<int> chainOffset_{0};
+    std::vector<int> chainNode_;
+  };
+
+} // namespace mu2e
+
+#endif/*PionProduction_SimParticleAncestry_hh*/
@@ -0,0 +1,259 @@
+#ifndef PionProduction_SimParticleSelector_hh
+#define PionProduction_SimParticleSelector_hh
+//
+// Configurable SimParticle selection shared by the PionProduction modules.
+//
+// The fhicl configuration is compiled at construction into a flat list of
+// tests, ordered from the cheapest (parent, simStage, PDG membership) to the most
+// expensive (regions, material), so that most particles are rejected after
+// one or two comparisons.  PDG membership is a bitset for the common codes
+// with a short list for nuclei.  An empty configuration accepts all
+// particles at the cost of one branch.
+//
+// All parameters have defaults, so a fhicl::Table of Config may be omitted
+// from the module configuration, giving an accept-all selection.
+//
+// Material tests need the PhysicalVolumeInfoMultiCollection; modules using
+// them call updateVolumes() from beginSubRun (or per event), which rebuilds
+// the per-volume tables only when the volume contents change.  Changes are
+// found with volumesSignature(), a hash of every volume's stage, index,
+// name, copy number and material.  The ProductID can not be used, since it
+// is the same for every subrun and event of a job.
+//
+
+#include <bitset>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "art/Framework/Principal/SubRun.h"
+#include "canvas/Persistency/Provenance/SubRunID.h"
+#include "canvas/Utilities/InputTag.h"
+#include "fhiclcpp/types/Atom.h"
+#include "fhiclcpp/types/OptionalAtom.h"
+#include "fhiclcpp/types/OptionalSequence.h"
+#include "fhiclcpp/types/Sequence.h"
+#include "fhiclcpp/types/Table.h"
+
+#include "Offline/MCDataProducts/inc/SimParticle.hh"
+#include "Offline/MCDataProducts/inc/PhysicalVolumeInfoMultiCollection.hh"
+
+namespace mu2e {
+
+  class SimParticleSelector {
+  public:
+
+    struct Box {
+      using Name=fhicl::Name;
+      using Comment=fhicl::Comment;
+      fhicl::Sequence<double,3> low{Name("low"), Comment("Lower (x, y, z) corner, mm")};
+      fhicl::Sequence<double,3> high{Name("high"), Comment("Upper (x, y, z) corner, mm")};
+    };
+
+    struct Config {
+      using Name=fhicl::Name;
+      using Comment=fhicl::Comment;
+      fhicl::Sequence<int> pdgIds{Name("pdgIds"), Comment("Accepted PDG IDs, empty for any"), std::vector<int>{}};
+      fhicl::Atom<bool> requireParent{Name("requireParent"), Comment("Accept only particles with a parent"), false};
+      fhicl::OptionalAtom<unsigned> minSimStage{Name("minSimStage"), Comment("Accept only simStage() >= minSimStage")};
+      fhicl::Atom<bool> requireStopped{Name("requireStopped"),
+          Comment("Accept only particles with zero end momentum or one of stoppingCodes"), false};
+      fhicl::Sequence<int> stoppingCodes{Name("stoppingCodes"),
+          Comment("ProcessCode ids also treated as stops by requireStopped, e.g. 13 for photon conversion"),
+          std::vector<int>{}};
+      fhicl::Sequence<std::string> materials{Name("materials"),
+          Comment("Accept only particles ending in one of these materials"), std::vector<std::string>{}};
+      fhicl::Sequence<std::string> vetoedMaterials{Name("vetoedMaterials"),
+          Comment("Reject particles ending in one of these materials"), std::vector<std::string>{}};
+      fhicl::Sequence<fhicl::Table<Box> > startRegions{Name("startRegions"),
+          Comment("Accept only particles starting inside one of these boxes"), std::vector<Box>{}};
+      fhicl::Sequence<fhicl::Table<Box> > endRegions{Name("endRegions"),
+          Comment("Accept only particles ending inside one of these boxes"), std::vector<Box>{}};
+      fhicl::OptionalSequence<double,2> startMomentum{Name("startMomentum"), Comment("[min, max] start momentum, MeV/c")};
+      fhicl::OptionalSequence<double,2> endMomentum{Name("endMomentum"), Comment("[min, max] end momentum, MeV/c")};
+    };
+
+    // Plain form of the configuration, for selections built in code
+    struct Settings {
+      struct Region {
+        double low[3];
+        double high[3];
+      };
+      std::vector<int> pdgIds;
+      bool requireParent = false;
+      bool hasMinSimStage = false;
+      unsigned minSimStage = 0;
+      bool requireStopped = false;
+      std::vector<int> stoppingCodes;
+      std::vector<std::string> materials;
+      std::vector<std::string> vetoedMaterials;
+      std::vector<Region> startRegions;
+      std::vector<Region> endRegions;
+      bool hasStartMomentum = false;
+      double startMomentum[2] = {0., 0.};
+      bool hasEndMomentum = false;
+      double endMomentum[2] = {0., 0.};
+    };
+
+    static Settings settings(const Config& conf);
+
+    // Accept-all selection
+    SimParticleSelector();
+    explicit SimParticleSelector(const Settings& settings);
+    explicit SimParticleSelector(const Config& conf);
+
+    bool accept(const SimParticle& particle) const {
+      for(const auto& t : tests_) {
+        if(!pass(t, particle)) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    bool empty() const { return tests_.empty(); }
+    bool needsVolumes() const { return needsVolumes_; }
+
+    // Content hash of the volume tables, equal for equal contents
+    static std::uint64_t volumesSignature(const PhysicalVolumeInfoMultiCollection& vols);
+
+    // Rebuild the material tables if the signature differs from the last one
+    void updateVolumes(const PhysicalVolumeInfoMultiCollection& vols, std::uint64_t signature);
+
+    void updateVolumes(const PhysicalVolumeInfoMultiCollection& vols) {
+      if(needsVolumes_) {
+        updateVolumes(vols, volumesSignature(vols));
+      }
+    }
+
+    template<class PRINCIPAL> void updateVolumes(const PRINCIPAL& p, const art::InputTag& tag) {
+      if(needsVolumes_) {
+        updateVolumes(*p.template getValidHandle<PhysicalVolumeInfoMultiCollection>(tag));
+      }
+    }
+
+    // A subrun product can not change within the subrun, so it is hashed
+    // once per subrun however often this is called
+    void updateVolumes(const art::SubRun& sr, const art::InputTag& tag) {
+      if(needsVolumes_ && !(haveSubRun_ && sr.id() == lastSubRun_)) {
+        updateVolumes(*sr.getValidHandle<PhysicalVolumeInfoMultiCollection>(tag));
+        haveSubRun_ = true;
+        lastSubRun_ = sr.id();
+      }
+    }
+
+    // Human readable list of the compiled tests, in evaluation order
+    std::string describe() const;
+
+  private:
+    enum class Kind { Parent, Stage, Pdg, Stopped, StartMomentum, EndMomentum, StartRegion, EndRegion, Material };
+
+    struct Test {
+      Kind kind;
+      unsigned index; // into regions_ or momenta_
+    };
+
+    struct Range2 {
+      double min2;
+      double max2;
+    };
+
+    // PDG codes with |code| < kDensePdg go to the bitset
+    static constexpr int kDensePdg = 4096;
+
+    std::vector<Test> tests_;
+
+    unsigned minSimStage_ = 0;
+    std::bitset<2*kDensePdg> densePdg_;
+    std::vector<int> sparsePdg_;
+    std::vector<int> stoppingCodes_;
+    std::vector<std::vector<Settings::Region> > regions_;
+    std::vector<Range2> momenta_;
+
+    std::vector<std::string> materials_;
+    std::vector<std::string> vetoedMaterials_;
+    bool needsVolumes_ = false;
+    bool haveVolumes_ = false;
+    std::uint64_t volsSignature_ = 0;
+    bool haveSubRun_ = false;
+    art::SubRunID lastSubRun_;
+    std::vector<std::vector<bool> > volumeAccepted_; // [simStage][volumeIndex]
+
+    void compile(const Settings& s);
+    bool pass(const Test& t, const SimParticle& particle) const;
+    bool pdgAccepted(int pdg) const;
+    bool materialAccepted(const std::string& material) const;
+  };
+
+  //================================================================
+  inline bool SimParticleSelector::pdgAccepted(int pdg) const {
+    if(pdg > -kDensePdg && pdg < kDensePdg) {
+      return densePdg_.test(pdg + kDensePdg);
+    }
+    for(int code : sparsePdg_) {
+      if(code == pdg) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  //================================================================
+  inline bool SimParticleSelector::pass(const Test& t, const SimParticle& particle) const {
+    switch(t.kind) {
+
+    case Kind::Parent:
+      return particle.hasParent();
+
+    case Kind::Stage:
+      return particle.simStage() >= minSimStage_;
+
+    case Kind::Pdg:
+      return pdgAccepted(particle.pdgId());
+
+    case Kind::Stopped:
+      if(particle.endMomentum().v().mag2() <= std::numeric_limits<double>::epsilon()) {
+        return true;
+      }
+      for(int code : stoppingCodes_) {
+        if(int(particle.stoppingCode().id()) == code) {
+          return true;
+        }
+      }
+      return false;
+
+    case Kind::StartMomentum:
+    case Kind::EndMomentum: {
+      const double p2 = (t.kind == Kind::StartMomentum)
+        ? particle.startMomentum().v().mag2() : particle.endMomentum().v().mag2();
+      return (momenta_[t.index].min2 <= p2) && (p2 <= momenta_[t.index].max2);
+    }
+
+    case Kind::StartRegion:
+    case Kind::EndRegion: {
+      const CLHEP::Hep3Vector& pos = (t.kind == Kind::StartRegion)
+        ? particle.startPosition() : particle.endPosition();
+      for(const auto& b : regions_[t.index]) {
+        if(b.low[0] <= pos.x() && pos.x() <= b.high[0] &&
+           b.low[1] <= pos.y() && pos.y() <= b.high[1] &&
+           b.low[2] <= pos.z() && pos.z() <= b.high[2]) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    case Kind::Material: {
+      const unsigned stage = particle.simStage();
+      const unsigned index = particle.endVolumeIndex();
+      return (stage < volumeAccepted_.size()) && (index < volumeAccepted_[stage].size())
+        && volumeAccepted_[stage][index];
+    }
+    }
+    return false;
+  }
+
+} // namespace mu2e
+
+#endif/*PionProduction_SimParticleSelector_hh*/
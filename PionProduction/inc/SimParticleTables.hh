@@ -0,0 +1,123 @@
+#ifndef PionProduction_SimParticleTables_hh
+#define PionProduction_SimParticleTables_hh
+//
+// Normalized output layout for the SimParticle ntuples.
+//
+// The flat layout of mySimParticlesExtracter (SimuParticle) and
+// myStoppedParticlesFinder (MuonStop) repeats the event id and 15 parent
+// fields on every row.  The normalized layout writes
+//
+//   particles: one ParticleRow per SimParticle and event, for the selected
+//              particles and their parents
+//   children:  one ChildRow per selected particle, with the keys of the
+//              particle and of its parent
+//
+// Joining children with particles on (RunID, SubRunID, EventID, Key) for
+// the particle and (..., ParentKey) for the parent gives back the flat
+// rows.  SimParticle keys are unique within an event across simulation
+// stages, so the parent may come from an earlier stage.
+//
+// FlatRow has the memory layout of the "hits" branch of the flat ntuples,
+// so existing files can be read into it with flatLeaves().  normalize()
+// and flatten() convert between the two layouts; the flat layout has no
+// keys, so normalize() assigns per-event keys in order of appearance and
+// merges parents with identical fields, and it has no end momentum for
+// the selected particle, which is set to zero.  mySimTablesConverter
+// runs them on existing files, see Convert_SimTables.fcl.
+//
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Offline/MCDataProducts/inc/SimParticle.hh"
+
+class TTree;
+
+namespace mu2e {
+  namespace SimParticleTables {
+
+    struct ParticleRow {
+      int RunID = -1;
+      int SubRunID = -1;
+      long long EventID = -1;
+      unsigned Key = 0;
+      int PID = 0;
+      float StartT = 0, EndT = 0;
+      float StartX = 0, StartY = 0, StartZ = 0;
+      float EndX = 0, EndY = 0, EndZ = 0;
+      float StartPx = 0, StartPy = 0, StartPz = 0;
+      float EndPx = 0, EndPy = 0, EndPz = 0;
+
+      ParticleRow() = default;
+      ParticleRow(int runID, int subrunID, long long eventID, unsigned key, const SimParticle& particle);
+
+      static const char* leaves();
+    };
+
+    struct ChildRow {
+      int RunID = -1;
+      int SubRunID = -1;
+      long long EventID = -1;
+      unsigned Key = 0;
+      unsigned ParentKey = 0;
+
+      static const char* leaves();
+    };
+
+    struct FlatRow {
+      int RunID = -1;
+      int SubRunID = -1;
+      long long EventID = -1;
+
+      int ParticlePID = 0;
+      float ParticleStartT = 0, ParticleEndT = 0;
+      float ParticleStartX = 0, ParticleStartY = 0, ParticleStartZ = 0;
+      float ParticleEndX = 0, ParticleEndY = 0, ParticleEndZ = 0;
+      float ParticleStartPx = 0, ParticleStartPy = 0, ParticleStartPz = 0;
+
+      int ParentPID = 0;
+      float ParentStartT = 0, ParentEndT = 0;
+      float ParentStartX = 0, ParentStartY = 0, ParentStartZ = 0;
+      float ParentEndX = 0, ParentEndY = 0, ParentEndZ = 0;
+      float ParentStartPx = 0, ParentStartPy = 0, ParentStartPz = 0;
+      float ParentEndPx = 0, ParentEndPy = 0, ParentEndPz = 0;
+
+      // Leaf list of the flat "hits" branch, with the given prefix for the
+      // particle fields ("Particle" for SimuParticle, "Muon" for MuonStop)
+      static std::string flatLeaves(const std::string& particlePrefix);
+    };
+
+    FlatRow flatten(const ParticleRow& particle, const ParticleRow& parent);
+
+    // Rows of the same event must be contiguous
+    void normalize(const std::vector<FlatRow>& rows,
+                   std::vector<ParticleRow>& particles,
+                   std::vector<ChildRow>& children);
+
+    // Writes the normalized trees from a module, each particle once per event
+    class Writer {
+    public:
+      void book(TTree* particles);
+      // Modules with several selections book one children tree for each
+      void bookChildren(TTree* children);
+
+      void beginEvent(int runID, int subrunID, long long eventID);
+
+      // Writes the particle and its parent rows unless already written in
+      // this event, and the child row to children
+      void add(const SimParticle& particle, TTree* children);
+
+    private:
+      TTree* particles_ = nullptr;
+      ParticleRow particle_;
+      ChildRow child_;
+      std::set<unsigned> written_;
+
+      void writeParticle(unsigned key, const SimParticle& particle);
+    };
+
+  } // namespace SimParticleTables
+} // namespace mu2e
+
+#endif/*PionProduction_SimParticleTables_hh*/
@@ -0,0 +1,81 @@
+#ifndef PionProduction_StopAcceptanceMap_hh
+#define PionProduction_StopAcceptanceMap_hh
+//
+// Probability that a pion or muon state saved at a virtual detector leads
+// to a selected stop, binned in species, distance from a reference axis,
+// momentum and the cosine of the angle to that axis.
+//
+// The map is learned by myStopAcceptanceMapBuilder from an unbiased two
+// stage production, counting in each cell the saved states and the states
+// with at least one stop among their descendants.  myStopAcceptanceCut
+// uses it to drop or Russian-roulette the resampled states that are
+// unlikely to stop.
+//
+// write() stores the counts as two THnD, <name>States and <name>Stops,
+// whose species axis is labelled with the PDG IDs, and the reference axis
+// as a one entry TTree <name>Axis (point, direction).  The outputs of jobs
+// with the same binning merge with hadd; read() takes the merged file.
+//
+
+#include <string>
+#include <vector>
+
+#include "CLHEP/Vector/ThreeVector.h"
+
+class TDirectory;
+namespace art { class TFileDirectory; }
+
+namespace mu2e {
+
+  class StopAcceptanceMap {
+  public:
+    struct Binning {
+      std::vector<int> pdgIds;
+      CLHEP::Hep3Vector axisPoint;
+      CLHEP::Hep3Vector axisDirection;
+      unsigned radiusBins = 1;
+      double maxRadius = 0.;
+      unsigned momentumBins = 1;
+      double minMomentum = 0.;
+      double maxMomentum = 0.;
+      unsigned cosThetaBins = 1;
+    };
+
+    StopAcceptanceMap() = default;
+    explicit StopAcceptanceMap(const Binning& binning);
+
+    // Map written by write(), throws if it is not found in dir
+    static StopAcceptanceMap read(TDirectory& dir, const std::string& name);
+
+    // Cell of a state, -1 for species or phase space outside the map
+    int cell(int pdgId, const CLHEP::Hep3Vector& position, const CLHEP::Hep3Vector& momentum) const;
+
+    void fill(int cell, bool stopped) {
+      ++states_[cell];
+      if(stopped) ++stops_[cell];
+    }
+
+    double states(int cell) const { return states_[cell]; }
+    double stops(int cell) const { return stops_[cell]; }
+
+    // Fraction of the states that stopped, or -1 below minStates states
+    double probability(int cell, double minStates) const {
+      return (states_[cell] >= minStates && states_[cell] > 0.) ? stops_[cell]/states_[cell] : -1.;
+    }
+
+    std::size_t size() const { return states_.size(); }
+    const Binning& binning() const { return binning_; }
+
+    void write(art::TFileDirectory& dir, const std::string& name) const;
+
+  private:
+    Binning binning_;
+    std::vector<double> states_;
+    std::vector<double> stops_;
+
+    int species(int pdgId) const;
+  };
+
+} // namespace mu2e
+
+#endif/*PionProduction_StopAcceptanceMap_hh*/
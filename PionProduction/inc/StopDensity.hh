@@ -0,0 +1,60 @@
+#ifndef PionProduction_StopDensity_hh
+#define PionProduction_StopDensity_hh
+//
+// In-job histogram of stop positions and times on an (x, y, z, t) grid.
+//
+// Two grids are used: a dense one for the stopping target, stored as a
+// flat array, and a coarser sparse one for everything else, stored as a
+// hash of the occupied voxels.  A stop inside the dense grid is counted
+// there only, so the full distribution is the sum of the two.  Stops
+// outside both grids are only counted.
+//
+// write() stores the dense grid as a THnD and the sparse one as a
+// THnSparseD with the configured binning; both merge with hadd when the
+// jobs used the same configuration.
+//
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace art { class TFileDirectory; }
+
+namespace mu2e {
+
+  class StopDensity {
+  public:
+    struct Grid {
+      double low[4];
+      double high[4];
+      unsigned bins[4];
+    };
+
+    StopDensity(const Grid& dense, const Grid& sparse);
+
+    void fill(double x, double y, double z, double t, double weight = 1.);
+
+    // Writes <name>Dense and <name>Sparse
+    void write(art::TFileDirectory& dir, const std::string& name, const std::string& title) const;
+
+    unsigned long denseStops() const { return nDense_; }
+    unsigned long sparseStops() const { return nSparse_; }
+    unsigned long outsideStops() const { return nOutside_; }
+    std::size_t sparseVoxels() const { return sparse_.size(); }
+
+  private:
+    Grid denseGrid_;
+    Grid sparseGrid_;
+    std::vector<double> dense_;
+    std::unordered_map<std::uint64_t, double> sparse_;
+    unsigned long nDense_ = 0;
+    unsigned long nSparse_ = 0;
+    unsigned long nOutside_ = 0;
+
+    static bool voxel(const Grid& g, const double v[4], unsigned idx[4]);
+  };
+
+} // namespace mu2e
+
+#endif/*PionProduction_StopDensity_hh*/
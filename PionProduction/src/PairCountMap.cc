@@ -0,0 +1,77 @@
+// Sparse count matrix over pairs of int codes.
+
+#include "PionProduction/inc/PairCountMap.hh"
+
+#include <algorithm>
+#include <map>
+
+#include "art_root_io/TFileDirectory.h"
+
+#include "TH2D.h"
+#include "TTree.h"
+
+namespace mu2e {
+
+  //================================================================
+  std::vector<PairCountMap::Entry> PairCountMap::entries() const {
+    std::vector<Entry> res;
+    res.reserve(size_);
+    for(const auto& s : slots_) {
+      if(s.count != 0) {
+        res.emplace_back(int(std::uint32_t(s.key >> 32)), int(std::uint32_t(s.key)), s.count);
+      }
+    }
+    std::sort(res.begin(), res.end());
+    return res;
+  }
+
+  //================================================================
+  void writePairCounts(const PairCountMap& counts, art::TFileDirectory& dir,
+                       const std::string& name, const std::string& title,
+                       const std::string& aName, const std::string& bName,
+                       unsigned maxBins) {
+    const auto cells = counts.entries();
+
+    struct Row {
+      int a;
+      int b;
+      unsigned long long count;
+    } row;
+    TTree* t = dir.make<TTree>(name.c_str(), title.c_str());
+    t->Branch("cells", &row, (aName + "/I:" + bName + "/I:Count/l").c_str());
+    for(const auto& c : cells) {
+      row.a = std::get<0>(c);
+      row.b = std::get<1>(c);
+      row.count = std::get<2>(c);
+      t->Fill();
+    }
+
+    // Dense bin numbers for the distinct codes on each axis
+    std::map<int, int> abins, bbins;
+    for(const auto& c : cells) {
+      abins.emplace(std::get<0>(c), 0);
+      bbins.emplace(std::get<1>(c), 0);
+    }
+    if(cells.empty() || abins.size() > maxBins || bbins.size() > maxBins) {
+      return;
+    }
+
+    TH2D* h = dir.make<TH2D>(("h_" + name).c_str(), (title + ";" + aName + ";" + bName).c_str(),
+                             abins.size(), 0., double(abins.size()), bbins.size(), 0., double(bbins.size()));
+    int ibin = 0;
+    for(auto& a : abins) {
+      a.second = ++ibin;
+      h->GetXaxis()->SetBinLabel(ibin, std::to_string(a.first).c_str());
+    }
+    ibin = 0;
+    for(auto& b : bbins) {
+      b.second = ++ibin;
+      h->GetYaxis()->SetBinLabel(ibin, std::to_string(b.first).c_str());
+    }
+    for(const auto& c : cells) {
+      h->SetBinContent(abins[std::get<0>(c)], bbins[std::get<1>(c)], double(std::get<2>(c)));
+    }
+    h->SetEntries(double(counts.total()));
+  }
+
+} // namespace mu2e
@@ -0,0 +1,82 @@
+// Point location among a list of axis-aligned boxes.
+
+#include "PionProduction/inc/RegionGrid.hh"
+
+#include <algorithm>
+#include <cmath>
+
+#include "cetlib_except/exception.h"
+
+namespace mu2e {
+
+  //================================================================
+  RegionGrid::RegionGrid(const std::vector<Box>& regions, unsigned divisions)
+    : regions_(regions)
+  {
+    if(regions_.empty()) {
+      return;
+    }
+
+    for(int i=0; i<3; ++i) {
+      low_[i] = regions_[0].low[i];
+      high_[i] = regions_[0].high[i];
+    }
+    for(const auto& b : regions_) {
+      for(int i=0; i<3; ++i) {
+        if(!(b.low[i] <= b.high[i])) {
+          throw cet::exception("BADCONFIG")<<"RegionGrid: region with low > high on axis "<<i<<"\n";
+        }
+        low_[i] = std::min(low_[i], b.low[i]);
+        high_[i] = std::max(high_[i], b.high[i]);
+      }
+    }
+
+    if(divisions == 0) {
+      // About eight cells per region, at most 64 per axis
+      divisions = std::min(64u, std::max(1u, unsigned(std::ceil(std::cbrt(8.*regions_.size())))));
+    }
+
+    for(int i=0; i<3; ++i) {
+      const double extent = high_[i] - low_[i];
+      n_[i] = (extent > 0.) ? divisions : 1;
+      invCell_[i] = (extent > 0.) ? n_[i]/extent : 0.;
+    }
+
+    // Compressed rows: count the regions per cell, then fill
+    auto cellRange = [&](const Box& b, int i, unsigned& first, unsigned& last) {
+      first = std::min(n_[i] - 1, unsigned((b.low[i] - low_[i])*invCell_[i]));
+      last = std::min(n_[i] - 1, unsigned((b.high[i] - low_[i])*invCell_[i]));
+    };
+
+    cellStart_.assign(cells() + 1, 0);
+    for(int pass = 0; pass < 2; ++pass) {
+      if(pass == 1) {
+        for(unsigned c = 0; c < cells(); ++c) {
+          cellStart_[c+1] += cellStart_[c];
+        }
+        cellRegions_.resize(cellStart_.back());
+      }
+      std::vector<unsigned> fill(cellStart_.begin(), cellStart_.end() - 1);
+      for(unsigned r = 0; r < regions_.size(); ++r) {
+        unsigned first[3], last[3];
+        for(int i=0; i<3; ++i) {
+          cellRange(regions_[r], i, first[i], last[i]);
+        }
+        for(unsigned iz = first[2]; iz <= last[2]; ++iz) {
+          for(unsigned iy = first[1]; iy <= last[1]; ++iy) {
+            for(unsigned ix = first[0]; ix <= last[0]; ++ix) {
+              const unsigned cell = (iz*n_[1] + iy)*n_[0] + ix;
+              if(pass == 0) {
+                ++cellStart_[cell+1];
+              }
+              else {
+                cellRegions_[fill[cell]++] = r;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+} // namespace mu2e
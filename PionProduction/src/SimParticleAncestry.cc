@@ -0,0 +1,140 @@
+// Per-event export of the full SimParticle ancestry of selected particles.
+
+#include "PionProduction/inc/SimParticleAncestry.hh"
+
+#include "TTree.h"
+
+namespace mu2e {
+
+  //================================================================
+  void SimParticleAncestry::book(TTree* tree) {
+    tree_ = tree;
+    tree_->Branch("RunID", &runID_, "RunID/I");
+    tree_->Branch("SubRunID", &subrunID_, "SubRunID/I");
+    tree_->Branch("EventID", &eventID_, "EventID/L");
+
+    tree_->Branch("Node_Key", &nodeKey_);
+    tree_->Branch("Node_Parent", &nodeParent_);
+    tree_->Branch("Node_PDG", &nodePdgId_);
+    tree_->Branch("Node_SimStage", &nodeSimStage_);
+    tree_->Branch("Node_CreationCode", &nodeCreationCode_);
+    tree_->Branch("Node_StoppingCode", &nodeStoppingCode_);
+    tree_->Branch("Node_StartT", &nodeStartT_);
+    tree_->Branch("Node_EndT", &nodeEndT_);
+    tree_->Branch("Node_StartX", &nodeStartX_);
+    tree_->Branch("Node_StartY", &nodeStartY_);
+    tree_->Branch("Node_StartZ", &nodeStartZ_);
+    tree_->Branch("Node_EndX", &nodeEndX_);
+    tree_->Branch("Node_EndY", &nodeEndY_);
+    tree_->Branch("Node_EndZ", &nodeEndZ_);
+    tree_->Branch("Node_StartPx", &nodeStartPx_);
+    tree_->Branch("Node_StartPy", &nodeStartPy_);
+    tree_->Branch("Node_StartPz", &nodeStartPz_);
+    tree_->Branch("Node_EndPx", &nodeEndPx_);
+    tree_->Branch("Node_EndPy", &nodeEndPy_);
+    tree_->Branch("Node_EndPz", &nodeEndPz_);
+
+    tree_->Branch("Chain_Offset", &chainOffset_);
+    tree_->Branch("Chain_Node", &chainNode_);
+  }
+
+  //================================================================
+  void SimParticleAncestry::clear() {
+    nodeIndex_.clear();
+
+    nodeKey_.clear();
+    nodeParent_.clear();
+    nodePdgId_.clear();
+    nodeSimStage_.clear();
+    nodeCreationCode_.clear();
+    nodeStoppingCode_.clear();
+    nodeStartT_.clear();  nodeEndT_.clear();
+    nodeStartX_.clear();  nodeStartY_.clear();  nodeStartZ_.clear();
+    nodeEndX_.clear();    nodeEndY_.clear();    nodeEndZ_.clear();
+    nodeStartPx_.clear(); nodeStartPy_.clear(); nodeStartPz_.clear();
+    nodeEndPx_.clear();   nodeEndPy_.clear();   nodeEndPz_.clear();
+
+    chainOffset_.assign(1, 0);
+    chainNode_.clear();
+  }
+
+  //================================================================
+  int SimParticleAncestry::addChain(const art::ProductID& pid,
+                                    const SimParticleCollection& particles,
+                                    const SimParticle& particle) {
+    // Walk up to the first ancestor already in the node table, or to the
+    // top of the available genealogy
+    pending_.clear();
+    int top = -1;
+    const SimParticle* p = &particle;
+    std::uint64_t key = nodeKey(pid, particle.id().asUint());
+    while(p) {
+      const auto found = nodeIndex_.find(key);
+      if(found != nodeIndex_.end()) {
+        top = found->second;
+        break;
+      }
+      pending_.emplace_back(p, key);
+      if(!p->hasParent()) {
+        break;
+      }
+      const auto& parent = p->parent();
+      key = nodeKey(parent.id(), parent.key());
+      if(parent.id() == pid) {
+        p = particles.getOrNull(cet::map_vector_key(parent.key()));
+      }
+      else {
+        p = parent.isAvailable() ? parent.get() : nullptr;
+      }
+    }
+
+    // New nodes are created parent first, so the parent row is known
+    for(auto i = pending_.rbegin(); i != pending_.rend(); ++i) {
+      const int node = addNode(*i->first, top);
+      nodeIndex_.emplace(i->second, node);
+      top = node;
+    }
+
+    for(int node = top; node >= 0; node = nodeParent_[node]) {
+      chainNode_.push_back(node);
+    }
+    chainOffset_.push_back(chainNode_.size());
+    return chainOffset_.size() - 2;
+  }
+
+  //================================================================
+  int SimParticleAncestry::addNode(const SimParticle& particle, int parent) {
+    nodeKey_.push_back(particle.id().asUint());
+    nodeParent_.push_back(parent);
+    nodePdgId_.push_back(particle.pdgId());
+    nodeSimStage_.push_back(particle.simStage());
+    nodeCreationCode_.push_back(particle.creationCode().id());
+    nodeStoppingCode_.push_back(particle.stoppingCode().id());
+    nodeStartT_.push_back(particle.startGlobalTime());
+    nodeEndT_.push_back(particle.endGlobalTime());
+    nodeStartX_.push_back(particle.startPosition().x());
+    nodeStartY_.push_back(particle.startPosition().y());
+    nodeStartZ_.push_back(particle.startPosition().z());
+    nodeEndX_.push_back(particle.endPosition().x());
+    nodeEndY_.push_back(particle.endPosition().y());
+    nodeEndZ_.push_back(particle.endPosition().z());
+    nodeStartPx_.push_back(particle.startMomentum().x());
+    nodeStartPy_.push_back(particle.startMomentum().y());
+    nodeStartPz_.push_back(particle.startMomentum().z());
+    nodeEndPx_.push_back(particle.endMomentum().x());
+    nodeEndPy_.push_back(particle.endMomentum().y());
+    nodeEndPz_.push_back(particle.endMomentum().z());
+    return nodeParent_.size() - 1;
+  }
+
+  //================================================================
+  void SimParticleAncestry::fill(int runID, int subrunID, long long eventID) {
+    if(chains() > 0) {
+      runID_ = runID;
+      subrunID_ = subrunID;
+      eventID_ = eventID;
+      tree_->Fill();
+    }
+  }
+
+} // namespace mu2e
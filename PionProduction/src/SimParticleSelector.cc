@@ -0,0 +1,192 @@
+// Configurable SimParticle selection shared by the PionProduction modules.
+
+#include "PionProduction/inc/SimParticleSelector.hh"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <sstream>
+
+#include "cetlib_except/exception.h"
+
+namespace mu2e {
+
+  //================================================================
+  SimParticleSelector::Settings SimParticleSelector::settings(const Config& conf) {
+    Settings s;
+    s.pdgIds = conf.pdgIds();
+    s.requireParent = conf.requireParent();
+    s.hasMinSimStage = conf.minSimStage(s.minSimStage);
+    s.requireStopped = conf.requireStopped();
+    s.stoppingCodes = conf.stoppingCodes();
+    s.materials = conf.materials();
+    s.vetoedMaterials = conf.vetoedMaterials();
+
+    for(const auto& b : conf.startRegions()) {
+      Settings::Region r;
+      for(unsigned i=0; i<3; ++i) { r.low[i] = b.low()[i]; r.high[i] = b.high()[i]; }
+      s.startRegions.push_back(r);
+    }
+    for(const auto& b : conf.endRegions()) {
+      Settings::Region r;
+      for(unsigned i=0; i<3; ++i) { r.low[i] = b.low()[i]; r.high[i] = b.high()[i]; }
+      s.endRegions.push_back(r);
+    }
+
+    std::array<double,2> range;
+    if((s.hasStartMomentum = conf.startMomentum(range))) {
+      s.startMomentum[0] = range[0];
+      s.startMomentum[1] = range[1];
+    }
+    if((s.hasEndMomentum = conf.endMomentum(range))) {
+      s.endMomentum[0] = range[0];
+      s.endMomentum[1] = range[1];
+    }
+    return s;
+  }
+
+  //================================================================
+  SimParticleSelector::SimParticleSelector() {}
+
+  SimParticleSelector::SimParticleSelector(const Settings& s) {
+    compile(s);
+  }
+
+  SimParticleSelector::SimParticleSelector(const Config& conf) {
+    compile(settings(conf));
+  }
+
+  //================================================================
+  void SimParticleSelector::compile(const Settings& s) {
+    // The order of the tests is the evaluation order: cheapest first.
+    if(s.requireParent) {
+      tests_.push_back(Test{Kind::Parent, 0});
+    }
+
+    if(s.hasMinSimStage) {
+      minSimStage_ = s.minSimStage;
+      tests_.push_back(Test{Kind::Stage, 0});
+    }
+
+    if(!s.pdgIds.empty()) {
+      for(int pdg : s.pdgIds) {
+        if(pdg > -kDensePdg && pdg < kDensePdg) {
+          densePdg_.set(pdg + kDensePdg);
+        }
+        else if(std::find(sparsePdg_.begin(), sparsePdg_.end(), pdg) == sparsePdg_.end()) {
+          sparsePdg_.push_back(pdg);
+        }
+      }
+      tests_.push_back(Test{Kind::Pdg, 0});
+    }
+
+    if(s.requireStopped) {
+      stoppingCodes_ = s.stoppingCodes;
+      tests_.push_back(Test{Kind::Stopped, 0});
+    }
+
+    if(s.hasStartMomentum) {
+      momenta_.push_back(Range2{s.startMomentum[0]*std::abs(s.startMomentum[0]), s.startMomentum[1]*s.startMomentum[1]});
+      tests_.push_back(Test{Kind::StartMomentum, unsigned(momenta_.size() - 1)});
+    }
+    if(s.hasEndMomentum) {
+      momenta_.push_back(Range2{s.endMomentum[0]*std::abs(s.endMomentum[0]), s.endMomentum[1]*s.endMomentum[1]});
+      tests_.push_back(Test{Kind::EndMomentum, unsigned(momenta_.size() - 1)});
+    }
+
+    if(!s.startRegions.empty()) {
+      regions_.push_back(s.startRegions);
+      tests_.push_back(Test{Kind::StartRegion, unsigned(regions_.size() - 1)});
+    }
+    if(!s.endRegions.empty()) {
+      regions_.push_back(s.endRegions);
+      tests_.push_back(Test{Kind::EndRegion, unsigned(regions_.size() - 1)});
+    }
+
+    if(!s.materials.empty() || !s.vetoedMaterials.empty()) {
+      materials_ = s.materials;
+      vetoedMaterials_ = s.vetoedMaterials;
+      needsVolumes_ = true;
+      tests_.push_back(Test{Kind::Material, 0});
+    }
+  }
+
+  //================================================================
+  bool SimParticleSelector::materialAccepted(const std::string& material) const {
+    if(std::find(vetoedMaterials_.begin(), vetoedMaterials_.end(), material) != vetoedMaterials_.end()) {
+      return false;
+    }
+    return materials_.empty() ||
+      (std::find(materials_.begin(), materials_.end(), material) != materials_.end());
+  }
+
+  //================================================================
+  std::uint64_t SimParticleSelector::volumesSignature(const PhysicalVolumeInfoMultiCollection& vols) {
+    // FNV-1a over the volume tables
+    std::uint64_t h = 14695981039346656037ull;
+    auto add = [&h](const void* data, std::size_t n) {
+      const unsigned char* c = static_cast<const unsigned char*>(data);
+      for(std::size_t i = 0; i < n; ++i) {
+        h = (h ^ c[i])*1099511628211ull;
+      }
+    };
+    const std::uint64_t stages = vols.size();
+    add(&stages, sizeof(stages));
+    for(const auto& stage : vols) {
+      const std::uint64_t size = stage.size();
+      add(&size, sizeof(size));
+      for(const auto& entry : stage) {
+        const std::uint64_t index = entry.first.asUint();
+        const std::int64_t copyNo = entry.second.copyNo();
+        add(&index, sizeof(index));
+        add(&copyNo, sizeof(copyNo));
+        add(entry.second.name().data(), entry.second.name().size() + 1);
+        add(entry.second.materialName().data(), entry.second.materialName().size() + 1);
+      }
+    }
+    return h;
+  }
+
+  //================================================================
+  void SimParticleSelector::updateVolumes(const PhysicalVolumeInfoMultiCollection& vols, std::uint64_t signature) {
+    if(!needsVolumes_ || (haveVolumes_ && signature == volsSignature_)) {
+      return;
+    }
+    haveVolumes_ = true;
+    volsSignature_ = signature;
+
+    volumeAccepted_.assign(vols.size(), std::vector<bool>());
+    for(unsigned stage = 0; stage < vols.size(); ++stage) {
+      unsigned maxIndex = 0;
+      for(const auto& entry : vols[stage]) {
+        maxIndex = std::max(maxIndex, unsigned(entry.first.asUint()));
+      }
+      volumeAccepted_[stage].assign(vols[stage].empty() ? 0 : maxIndex + 1, false);
+      for(const auto& entry : vols[stage]) {
+        volumeAccepted_[stage][entry.first.asUint()] = materialAccepted(entry.second.materialName());
+      }
+    }
+  }
+
+  //================================================================
+  std::string SimParticleSelector::describe() const {
+    std::ostringstream os;
+    os<<"[";
+    for(const auto& t : tests_) {
+      switch(t.kind) {
+      case Kind::Parent: os<<" parent"; break;
+      case Kind::Stage: os<<" simStage>="<<minSimStage_; break;
+      case Kind::Pdg: os<<" pdg("<<densePdg_.count() + sparsePdg_.size()<<" codes)"; break;
+      case Kind::Stopped: os<<" stopped"; break;
+      case Kind::StartMomentum: os<<" startMomentum"; break;
+      case Kind::EndMomentum: os<<" endMomentum"; break;
+      case Kind::StartRegion: os<<" startRegion("<<regions_[t.index].size()<<" boxes)"; break;
+      case Kind::EndRegion: os<<" endRegion("<<regions_[t.index].size()<<" boxes)"; break;
+      case Kind::Material: os<<" material"; break;
+      }
+    }
+    os<<" ]";
+    return os.str();
+  }
+
+} // namespace mu2e
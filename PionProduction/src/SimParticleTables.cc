@@ -0,0 +1,195 @@
+// Normalized output layout for the SimParticle ntuples.
+
+#include "PionProduction/inc/SimParticleTables.hh"
+
+#include <array>
+#include <map>
+#include <utility>
+
+#include "TTree.h"
+
+namespace mu2e {
+  namespace SimParticleTables {
+
+    //================================================================
+    ParticleRow::ParticleRow(int runID, int subrunID, long long eventID, unsigned key, const SimParticle& particle)
+      : RunID(runID), SubRunID(subrunID), EventID(eventID), Key(key)
+      , PID(particle.pdgId()), StartT(particle.startGlobalTime()), EndT(particle.endGlobalTime())
+      , StartX(particle.startPosition().x()), StartY(particle.startPosition().y()), StartZ(particle.startPosition().z())
+      , EndX(particle.endPosition().x()), EndY(particle.endPosition().y()), EndZ(particle.endPosition().z())
+      , StartPx(particle.startMomentum().x()), StartPy(particle.startMomentum().y()), StartPz(particle.startMomentum().z())
+      , EndPx(particle.endMomentum().x()), EndPy(particle.endMomentum().y()), EndPz(particle.endMomentum().z())
+    {}
+
+    const char* ParticleRow::leaves() {
+      return "RunID/I:SubRunID/I:EventID/L:Key/i:PID/I:StartT/F:EndT/F:StartX/F:StartY/F:StartZ/F:EndX/F:EndY/F:EndZ/F:StartPx/F:StartPy/F:StartPz/F:EndPx/F:EndPy/F:EndPz/F";
+    }
+
+    const char* ChildRow::leaves() {
+      return "RunID/I:SubRunID/I:EventID/L:Key/i:ParentKey/i";
+    }
+
+    //================================================================
+    std::string FlatRow::flatLeaves(const std::string& p) {
+      return "RunID/I:SubRunID/I:EventID/L:"
+        + p + "PID/I:" + p + "StartT/F:" + p + "EndT/F:"
+        + p + "StartX/F:" + p + "StartY/F:" + p + "StartZ/F:"
+        + p + "EndX/F:" + p + "EndY/F:" + p + "EndZ/F:"
+        + p + "StartPx/F:" + p + "StartPy/F:" + p + "StartPz/F:"
+        "ParentPID/I:ParentStartT/F:ParentEndT/F:ParentStartX/F:ParentStartY/F:ParentStartZ/F:ParentEndX/F:ParentEndY/F:ParentEndZ/F:ParentStartPx/F:ParentStartPy/F:ParentStartPz/F:ParentEndPx/F:ParentEndPy/F:ParentEndPz/F";
+    }
+
+    //================================================================
+    FlatRow flatten(const ParticleRow& particle, const ParticleRow& parent) {
+      FlatRow r;
+      r.RunID = particle.RunID;
+      r.SubRunID = particle.SubRunID;
+      r.EventID = particle.EventID;
+
+      r.ParticlePID = particle.PID;
+      r.ParticleStartT = particle.StartT;
+      r.ParticleEndT = particle.EndT;
+      r.ParticleStartX = particle.StartX;
+      r.ParticleStartY = particle.StartY;
+      r.ParticleStartZ = particle.StartZ;
+      r.ParticleEndX = particle.EndX;
+      r.ParticleEndY = particle.EndY;
+      r.ParticleEndZ = particle.EndZ;
+      r.ParticleStartPx = particle.StartPx;
+      r.ParticleStartPy = particle.StartPy;
+      r.ParticleStartPz = particle.StartPz;
+
+      r.ParentPID = parent.PID;
+      r.ParentStartT = parent.StartT;
+      r.ParentEndT = parent.EndT;
+      r.ParentStartX = parent.StartX;
+      r.ParentStartY = parent.StartY;
+      r.ParentStartZ = parent.StartZ;
+      r.ParentEndX = parent.EndX;
+      r.ParentEndY = parent.EndY;
+      r.ParentEndZ = parent.EndZ;
+      r.ParentStartPx = parent.StartPx;
+      r.ParentStartPy = parent.StartPy;
+      r.ParentStartPz = parent.StartPz;
+      r.ParentEndPx = parent.EndPx;
+      r.ParentEndPy = parent.EndPy;
+      r.ParentEndPz = parent.EndPz;
+      return r;
+    }
+
+    //================================================================
+    void normalize(const std::vector<FlatRow>& rows,
+                   std::vector<ParticleRow>& particles,
+                   std::vector<ChildRow>& children) {
+      typedef std::pair<int, std::array<float,14> > ParentFields;
+      std::map<ParentFields, unsigned> parentKeys;
+      unsigned nextKey = 1;
+
+      for(unsigned i = 0; i < rows.size(); ++i) {
+        const FlatRow& r = rows[i];
+        if(i == 0 || r.EventID != rows[i-1].EventID || r.SubRunID != rows[i-1].SubRunID || r.RunID != rows[i-1].RunID) {
+          parentKeys.clear();
+          nextKey = 1;
+        }
+
+        ParticleRow parent;
+        parent.RunID = r.RunID;
+        parent.SubRunID = r.SubRunID;
+        parent.EventID = r.EventID;
+        parent.PID = r.ParentPID;
+        parent.StartT = r.ParentStartT;
+        parent.EndT = r.ParentEndT;
+        parent.StartX = r.ParentStartX;
+        parent.StartY = r.ParentStartY;
+        parent.StartZ = r.ParentStartZ;
+        parent.EndX = r.ParentEndX;
+        parent.EndY = r.ParentEndY;
+        parent.EndZ = r.ParentEndZ;
+        parent.StartPx = r.ParentStartPx;
+        parent.StartPy = r.ParentStartPy;
+        parent.StartPz = r.ParentStartPz;
+        parent.EndPx = r.ParentEndPx;
+        parent.EndPy = r.ParentEndPy;
+        parent.EndPz = r.ParentEndPz;
+
+        const ParentFields fields(parent.PID, {{ parent.StartT, parent.EndT,
+                parent.StartX, parent.StartY, parent.StartZ, parent.EndX, parent.EndY, parent.EndZ,
+                parent.StartPx, parent.StartPy, parent.StartPz, parent.EndPx, parent.EndPy, parent.EndPz }});
+        auto ip = parentKeys.find(fields);
+        if(ip == parentKeys.end()) {
+          ip = parentKeys.emplace(fields, nextKey++).first;
+          parent.Key = ip->second;
+          particles.push_back(parent);
+        }
+
+        ParticleRow particle;
+        particle.RunID = r.RunID;
+        particle.SubRunID = r.SubRunID;
+        particle.EventID = r.EventID;
+        particle.Key = nextKey++;
+        particle.PID = r.ParticlePID;
+        particle.StartT = r.ParticleStartT;
+        particle.EndT = r.ParticleEndT;
+        particle.StartX = r.ParticleStartX;
+        particle.StartY = r.ParticleStartY;
+        particle.StartZ = r.ParticleStartZ;
+        particle.EndX = r.ParticleEndX;
+        particle.EndY = r.ParticleEndY;
+        particle.EndZ = r.ParticleEndZ;
+        particle.StartPx = r.ParticleStartPx;
+        particle.StartPy = r.ParticleStartPy;
+        particle.StartPz = r.ParticleStartPz;
+        particles.push_back(particle);
+
+        ChildRow child;
+        child.RunID = r.RunID;
+        child.SubRunID = r.SubRunID;
+        child.EventID = r.EventID;
+        child.Key = particle.Key;
+        child.ParentKey = ip->second;
+        children.push_back(child);
+      }
+    }
+
+    //================================================================
+    void Writer::book(TTree* particles) {
+      particles_ = particles;
+      particles_->Branch("particles", &particle_, ParticleRow::leaves());
+    }
+
+    void Writer::bookChildren(TTree* children) {
+      children->Branch("children", &child_, ChildRow::leaves());
+    }
+
+    //================================================================
+    void Writer::beginEvent(int runID, int subrunID, long long eventID) {
+      child_.RunID = runID;
+      child_.SubRunID = subrunID;
+      child_.EventID = eventID;
+      written_.clear();
+    }
+
+    //================================================================
+    void Writer::writeParticle(unsigned key, const SimParticle& particle) {
+      particle_ = ParticleRow(child_.RunID, child_.SubRunID, child_.EventID, key, particle);
+      particles_->Fill();
+    }
+
+    //================================================================
+    void Writer::add(const SimParticle& particle, TTree* children) {
+      const auto& parent = particle.parent();
+
+      child_.Key = particle.id().asUint();
+      child_.ParentKey = parent.key();
+
+      if(written_.insert(child_.Key).second) {
+        writeParticle(child_.Key, particle);
+      }
+      if(written_.insert(child_.ParentKey).second) {
+        writeParticle(child_.ParentKey, *parent);
+      }
+      children->Fill();
+    }
+
+  } // namespace SimParticleTables
+} // namespace mu2e
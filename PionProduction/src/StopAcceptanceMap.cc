@@ -0,0 +1,163 @@
+// Stop probability of saved pion and muon states, see StopAcceptanceMap.hh.
+
+#include "PionProduction/inc/StopAcceptanceMap.hh"
+
+#include <algorithm>
+#include <string>
+
+#include "cetlib_except/exception.h"
+
+#include "art_root_io/TFileDirectory.h"
+
+#include "TAxis.h"
+#include "TDirectory.h"
+#include "THn.h"
+#include "TTree.h"
+
+namespace mu2e {
+
+  namespace {
+    const char* axisNames[4] = {"species", "r", "p", "cosTheta"};
+    const char axisLeaves[] = "X0/D:Y0/D:Z0/D:DX/D:DY/D:DZ/D";
+  }
+
+  //================================================================
+  StopAcceptanceMap::StopAcceptanceMap(const Binning& binning)
+    : binning_(binning)
+  {
+    const Binning& b = binning_;
+    if(b.pdgIds.empty() || b.radiusBins == 0 || b.momentumBins == 0 || b.cosThetaBins == 0
+       || !(b.maxRadius > 0.) || !(b.minMomentum < b.maxMomentum) || !(b.axisDirection.mag() > 0.)) {
+      throw cet::exception("BADCONFIG")<<"StopAcceptanceMap: need species, non-zero bin counts,"
+                                       <<" maxRadius > 0, minMomentum < maxMomentum and an axis direction\n";
+    }
+    binning_.axisDirection = b.axisDirection.unit();
+    const std::size_t n = b.pdgIds.size()*b.radiusBins*b.momentumBins*b.cosThetaBins;
+    states_.assign(n, 0.);
+    stops_.assign(n, 0.);
+  }
+
+  //================================================================
+  int StopAcceptanceMap::species(int pdgId) const {
+    for(unsigned i = 0; i < binning_.pdgIds.size(); ++i) {
+      if(binning_.pdgIds[i] == pdgId) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  //================================================================
+  int StopAcceptanceMap::cell(int pdgId, const CLHEP::Hep3Vector& position, const CLHEP::Hep3Vector& momentum) const {
+    const Binning& b = binning_;
+
+    const int is = species(pdgId);
+    if(is < 0) return -1;
+
+    const double p = momentum.mag();
+    if(!(b.minMomentum <= p && p < b.maxMomentum)) return -1;
+    const unsigned ip = unsigned((p - b.minMomentum)/(b.maxMomentum - b.minMomentum)*b.momentumBins);
+
+    const CLHEP::Hep3Vector d = position - b.axisPoint;
+    const double r = (d - d.dot(b.axisDirection)*b.axisDirection).mag();
+    if(!(r < b.maxRadius)) return -1;
+    const unsigned ir = unsigned(r/b.maxRadius*b.radiusBins);
+
+    // Rounding can put cosTheta just outside [-1, 1]
+    const double cosTheta = std::clamp((p > 0.) ? momentum.dot(b.axisDirection)/p : 1., -1., 1.);
+    const unsigned ic = unsigned((cosTheta + 1.)/2.*b.cosThetaBins);
+
+    return int(((is*b.radiusBins + std::min(ir, b.radiusBins - 1))*b.momentumBins
+                + std::min(ip, b.momentumBins - 1))*b.cosThetaBins + std::min(ic, b.cosThetaBins - 1));
+  }
+
+  //================================================================
+  void StopAcceptanceMap::write(art::TFileDirectory& dir, const std::string& name) const {
+    const Binning& b = binning_;
+    const int bins[4] = { int(b.pdgIds.size()), int(b.radiusBins), int(b.momentumBins), int(b.cosThetaBins) };
+    const double low[4] = { 0., 0., b.minMomentum, -1. };
+    const double high[4] = { double(b.pdgIds.size()), b.maxRadius, b.maxMomentum, 1. };
+
+    // THn objects are not attached to a directory on construction, register them explicitly
+    const std::string sname = name + "States", tname = name + "Stops";
+    THnD* hs = dir.makeAndRegister<THnD>(sname.c_str(), "Saved states", sname.c_str(), "Saved states",
+                                         4, bins, low, high);
+    THnD* ht = dir.makeAndRegister<THnD>(tname.c_str(), "Saved states with a stop", tname.c_str(),
+                                         "Saved states with a stop", 4, bins, low, high);
+    for(THnD* h : {hs, ht}) {
+      for(int i = 0; i < 4; ++i) {
+        h->GetAxis(i)->SetName(axisNames[i]);
+      }
+      for(unsigned i = 0; i < b.pdgIds.size(); ++i) {
+        h->GetAxis(0)->SetBinLabel(i + 1, std::to_string(b.pdgIds[i]).c_str());
+      }
+    }
+
+    int ibin[4];
+    unsigned cell = 0;
+    for(unsigned is = 0; is < b.pdgIds.size(); ++is) {
+      for(unsigned ir = 0; ir < b.radiusBins; ++ir) {
+        for(unsigned ip = 0; ip < b.momentumBins; ++ip) {
+          for(unsigned ic = 0; ic < b.cosThetaBins; ++ic, ++cell) {
+            ibin[0] = is + 1; ibin[1] = ir + 1; ibin[2] = ip + 1; ibin[3] = ic + 1;
+            if(states_[cell] != 0.) hs->SetBinContent(ibin, states_[cell]);
+            if(stops_[cell] != 0.) ht->SetBinContent(ibin, stops_[cell]);
+          }
+        }
+      }
+    }
+
+    double axis[6] = { b.axisPoint.x(), b.axisPoint.y(), b.axisPoint.z(),
+                       b.axisDirection.x(), b.axisDirection.y(), b.axisDirection.z() };
+    TTree* at = dir.make<TTree>((name + "Axis").c_str(), "Reference axis point and direction");
+    at->Branch("axis", axis, axisLeaves);
+    at->Fill();
+    at->ResetBranchAddresses();
+  }
+
+  //================================================================
+  StopAcceptanceMap StopAcceptanceMap::read(TDirectory& dir, const std::string& name) {
+    const THnBase* hs = dynamic_cast<const THnBase*>(dir.Get((name + "States").c_str()));
+    const THnBase* ht = dynamic_cast<const THnBase*>(dir.Get((name + "Stops").c_str()));
+    TTree* at = dynamic_cast<TTree*>(dir.Get((name + "Axis").c_str()));
+    if(!hs || !ht || !at || at->GetEntries() == 0 || hs->GetNdimensions() != 4 || ht->GetNdimensions() != 4) {
+      throw cet::exception("BADINPUT")<<"StopAcceptanceMap: no map "<<name<<" in "<<dir.GetPath()<<"\n";
+    }
+
+    Binning b;
+    const TAxis* as = hs->GetAxis(0);
+    for(int i = 1; i <= as->GetNbins(); ++i) {
+      b.pdgIds.push_back(std::stoi(as->GetBinLabel(i)));
+    }
+    b.radiusBins = hs->GetAxis(1)->GetNbins();
+    b.maxRadius = hs->GetAxis(1)->GetXmax();
+    b.momentumBins = hs->GetAxis(2)->GetNbins();
+    b.minMomentum = hs->GetAxis(2)->GetXmin();
+    b.maxMomentum = hs->GetAxis(2)->GetXmax();
+    b.cosThetaBins = hs->GetAxis(3)->GetNbins();
+    // Merged files have one identical entry per job
+    double axis[6];
+    at->SetBranchAddress("axis", axis);
+    at->GetEntry(0);
+    at->ResetBranchAddresses();
+    b.axisPoint.set(axis[0], axis[1], axis[2]);
+    b.axisDirection.set(axis[3], axis[4], axis[5]);
+
+    StopAcceptanceMap map(b);
+    int ibin[4];
+    unsigned cell = 0;
+    for(unsigned is = 0; is < b.pdgIds.size(); ++is) {
+      for(unsigned ir = 0; ir < b.radiusBins; ++ir) {
+        for(unsigned ip = 0; ip < b.momentumBins; ++ip) {
+          for(unsigned ic = 0; ic < b.cosThetaBins; ++ic, ++cell) {
+            ibin[0] = is + 1; ibin[1] = ir + 1; ibin[2] = ip + 1; ibin[3] = ic + 1;
+            map.states_[cell] = hs->GetBinContent(ibin);
+            map.stops_[cell] = ht->GetBinContent(ibin);
+          }
+        }
+      }
+    }
+    return map;
+  }
+
+} // namespace mu2e
@@ -0,0 +1,111 @@
+// In-job histogram of stop positions and times on an (x, y, z, t) grid.
+
+#include "PionProduction/inc/StopDensity.hh"
+
+#include "cetlib_except/exception.h"
+
+#include "art_root_io/TFileDirectory.h"
+
+#include "THnSparse.h"
+#include "THn.h"
+
+namespace mu2e {
+
+  namespace {
+    void checkGrid(const StopDensity::Grid& g, const char* what) {
+      for(int i=0; i<4; ++i) {
+        if(g.bins[i] == 0 || g.bins[i] >= 0xffff || !(g.low[i] < g.high[i])) {
+          throw cet::exception("BADCONFIG")<<"StopDensity: bad "<<what<<" grid on axis "<<i
+                                           <<", need low < high and 0 < bins < 65535\n";
+        }
+      }
+    }
+
+    const char* axisNames[4] = {"x", "y", "z", "t"};
+  }
+
+  //================================================================
+  StopDensity::StopDensity(const Grid& dense, const Grid& sparse)
+    : denseGrid_(dense), sparseGrid_(sparse)
+  {
+    checkGrid(denseGrid_, "dense");
+    checkGrid(sparseGrid_, "sparse");
+    dense_.assign(std::size_t(dense.bins[0])*dense.bins[1]*dense.bins[2]*dense.bins[3], 0.);
+  }
+
+  //================================================================
+  bool StopDensity::voxel(const Grid& g, const double v[4], unsigned idx[4]) {
+    for(int i=0; i<4; ++i) {
+      if(!(g.low[i] <= v[i] && v[i] < g.high[i])) {
+        return false;
+      }
+      idx[i] = unsigned((v[i] - g.low[i])/(g.high[i] - g.low[i])*g.bins[i]);
+      if(idx[i] >= g.bins[i]) idx[i] = g.bins[i] - 1;
+    }
+    return true;
+  }
+
+  //================================================================
+  void StopDensity::fill(double x, double y, double z, double t, double weight) {
+    const double v[4] = {x, y, z, t};
+    unsigned idx[4];
+    if(voxel(denseGrid_, v, idx)) {
+      const Grid& g = denseGrid_;
+      dense_[((std::size_t(idx[3])*g.bins[2] + idx[2])*g.bins[1] + idx[1])*g.bins[0] + idx[0]] += weight;
+      ++nDense_;
+    }
+    else if(voxel(sparseGrid_, v, idx)) {
+      const std::uint64_t key = (std::uint64_t(idx[3]) << 48) | (std::uint64_t(idx[2]) << 32)
+        | (std::uint64_t(idx[1]) << 16) | idx[0];
+      sparse_[key] += weight;
+      ++nSparse_;
+    }
+    else {
+      ++nOutside_;
+    }
+  }
+
+  //================================================================
+  void StopDensity::write(art::TFileDirectory& dir, const std::string& name, const std::string& title) const {
+    int bins[4];
+    double low[4], high[4];
+
+    for(int i=0; i<4; ++i) { bins[i] = denseGrid_.bins[i]; low[i] = denseGrid_.low[i]; high[i] = denseGrid_.high[i]; }
+    // THn objects are not attached to a directory on construction, register them explicitly
+    const std::string dname = name + "Dense", dtitle = title + ", target grid";
+    THnD* hd = dir.makeAndRegister<THnD>(dname.c_str(), dtitle.c_str(), dname.c_str(), dtitle.c_str(), 4, bins, low, high);
+    int ibin[4];
+    for(unsigned it = 0; it < denseGrid_.bins[3]; ++it) {
+      for(unsigned iz = 0; iz < denseGrid_.bins[2]; ++iz) {
+        for(unsigned iy = 0; iy < denseGrid_.bins[1]; ++iy) {
+          for(unsigned ix = 0; ix < denseGrid_.bins[0]; ++ix) {
+            const double w = dense_[((std::size_t(it)*denseGrid_.bins[2] + iz)*denseGrid_.bins[1] + iy)*denseGrid_.bins[0] + ix];
+            if(w != 0.) {
+              ibin[0] = ix + 1; ibin[1] = iy + 1; ibin[2] = iz + 1; ibin[3] = it + 1;
+              hd->SetBinContent(ibin, w);
+            }
+          }
+        }
+      }
+    }
+    hd->SetEntries(double(nDense_));
+
+    for(int i=0; i<4; ++i) { bins[i] = sparseGrid_.bins[i]; low[i] = sparseGrid_.low[i]; high[i] = sparseGrid_.high[i]; }
+    const std::string sname = name + "Sparse", stitle = title + ", outside the target grid";
+    THnSparseD* hs = dir.makeAndRegister<THnSparseD>(sname.c_str(), stitle.c_str(), sname.c_str(), stitle.c_str(),
+                                                     4, bins, low, high);
+    for(const auto& v : sparse_) {
+      for(int i=0; i<4; ++i) {
+        ibin[i] = int((v.first >> (16*i)) & 0xffff) + 1;
+      }
+      hs->SetBinContent(ibin, v.second);
+    }
+    hs->SetEntries(double(nSparse_));
+
+    for(int i=0; i<4; ++i) {
+      hd->GetAxis(i)->SetName(axisNames[i]);
+      hs->GetAxis(i)->SetName(axisNames[i]);
+    }
+  }
+
+} // namespace mu2e
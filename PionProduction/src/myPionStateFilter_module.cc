@@ -0,0 +1,87 @@
+// Keep the events with saved pion and muon states, see myPionStateProducer.
+// The endJob summary gives the number of kept events and states, the
+// denominator of the reuse factor of the second stage.
+
+#include <string>
+#include <sstream>
+
+#include "messagefacility/MessageLogger/MessageLogger.h"
+
+#include "fhiclcpp/types/Atom.h"
+#include "canvas/Utilities/InputTag.h"
+
+#include "art/Framework/Core/EDFilter.h"
+#include "art/Framework/Principal/Event.h"
+#include "art/Framework/Principal/Handle.h"
+
+// Mu2e includes.
+#include "Offline/MCDataProducts/inc/StepPointMC.hh"
+
+namespace mu2e {
+
+  //================================================================
+  class myPionStateFilter : public art::EDFilter {
+    public:
+      struct Config {
+        using Name=fhicl::Name;
+        using Comment=fhicl::Comment;
+
+        fhicl::Atom<art::InputTag> stepPointMCsTag{ Name("stepPointMCsTag"),
+          Comment("StepPointMCs written by myPionStateProducer")
+        };
+
+        fhicl::Atom<unsigned> minStates{ Name("minStates"),
+          Comment("Keep events with at least this many saved states"), 1
+        };
+      };
+
+      using Parameters = art::EDFilter::Table<Config>;
+      explicit myPionStateFilter(const Parameters& conf);
+
+      bool filter(art::Event& evt) override;
+      void endJob() override;
+
+    private:
+      art::ProductToken<StepPointMCCollection> stepPointMCsToken_;
+      unsigned minStates_;
+
+      unsigned long numEvents_;
+      unsigned long numPassed_;
+      unsigned long numStates_;
+  };
+
+  //================================================================
+  myPionStateFilter::myPionStateFilter(const Parameters& conf)
+    : art::EDFilter{conf}
+    , stepPointMCsToken_(consumes<StepPointMCCollection>(conf().stepPointMCsTag()))
+    , minStates_(conf().minStates())
+    , numEvents_(0)
+    , numPassed_(0)
+    , numStates_(0)
+  {}
+
+  //================================================================
+  bool myPionStateFilter::filter(art::Event& event) {
+    const auto& steps = event.getProduct(stepPointMCsToken_);
+    ++numEvents_;
+    if(steps.size() < minStates_) {
+      return false;
+    }
+    ++numPassed_;
+    numStates_ += steps.size();
+    return true;
+  }
+
+  //================================================================
+  void myPionStateFilter::endJob() {
+    std::ostringstream os;
+    os<<"myPionStateFilter stats: passed "<<numPassed_<<" of "<<numEvents_
+      <<" events, "<<numStates_<<" saved states";
+    mf::LogInfo("Summary")<<os.str();
+  }
+
+  //================================================================
+
+} // namespace mu2e
+
+DEFINE_ART_MODULE(mu2e::myPionStateFilter)
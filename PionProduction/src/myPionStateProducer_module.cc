@@ -0,0 +1,164 @@
+// Select the pion and muon StepPointMCs at a virtual detector downstream
+// of the production target and write them to a new StepPointMCCollection.
+// This is the first stage of the two stage stopped muon production, see
+// FCL/myPionStatesStage1.fcl.  The second stage resamples the saved states
+// with ResamplingMixer and simulates only their transport to the stops.
+//
+// With firstCrossingOnly a particle that crosses the detector several
+// times is saved once, at its earliest crossing, so that each particle is
+// resampled with the same weight.
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <iostream>
+#include <sstream>
+
+#include "cetlib_except/exception.h"
+
+#include "messagefacility/MessageLogger/MessageLogger.h"
+
+#include "fhiclcpp/types/Atom.h"
+#include "fhiclcpp/types/Sequence.h"
+#include "canvas/Utilities/InputTag.h"
+
+#include "art/Framework/Core/EDProducer.h"
+#include "art/Framework/Principal/Event.h"
+#include "art/Framework/Principal/Handle.h"
+
+// Mu2e includes.
+#include "Offline/MCDataProducts/inc/SimParticle.hh"
+#include "Offline/MCDataProducts/inc/StepPointMC.hh"
+
+namespace mu2e {
+
+  //================================================================
+  class myPionStateProducer : public art::EDProducer {
+    public:
+      struct Config {
+        using Name=fhicl::Name;
+        using Comment=fhicl::Comment;
+
+        fhicl::Atom<art::InputTag> stepPointMCsTag{ Name("stepPointMCsTag"),
+          Comment("Input virtual detector StepPointMCs"), "g4run:virtualdetector"
+        };
+
+        fhicl::Sequence<unsigned> virtualDetectorIds{ Name("virtualDetectorIds"),
+          Comment("Virtual detectors at which the states are saved")
+        };
+
+        fhicl::Sequence<int> particleTypes{ Name("particleTypes"),
+          Comment("PDG IDs of the saved particles"), std::vector<int>{ 211, -211, 13, -13 }
+        };
+
+        fhicl::Atom<double> minMomentum{ Name("minMomentum"),
+          Comment("Save only steps with at least this momentum, MeV/c"), 0.
+        };
+
+        fhicl::Atom<bool> firstCrossingOnly{ Name("firstCrossingOnly"),
+          Comment("Save at most one step, the earliest, per SimParticle"), true
+        };
+
+        fhicl::Atom<int> verbosityLevel{ Name("verbosityLevel"),
+          Comment("Controls the printouts.  Levels 0 and 1 are used."), 0
+        };
+      };
+
+      using Parameters = art::EDProducer::Table<Config>;
+      explicit myPionStateProducer(const Parameters& conf);
+
+      void produce(art::Event& evt) override;
+      void endJob() override;
+
+    private:
+      art::ProductToken<StepPointMCCollection> stepPointMCsToken_;
+      std::set<unsigned> virtualDetectorIds_;
+      std::set<int> particleTypes_;
+      double minMomentum_;
+      bool firstCrossingOnly_;
+      int verbosityLevel_;
+
+      unsigned long numInputSteps_;
+      unsigned long numEvents_;
+      std::map<int, unsigned long> numSaved_;
+  };
+
+  //================================================================
+  myPionStateProducer::myPionStateProducer(const Parameters& conf)
+    : art::EDProducer{conf}
+    , stepPointMCsToken_(consumes<StepPointMCCollection>(conf().stepPointMCsTag()))
+    , virtualDetectorIds_(conf().virtualDetectorIds().begin(), conf().virtualDetectorIds().end())
+    , particleTypes_(conf().particleTypes().begin(), conf().particleTypes().end())
+    , minMomentum_(conf().minMomentum())
+    , firstCrossingOnly_(conf().firstCrossingOnly())
+    , verbosityLevel_(conf().verbosityLevel())
+    , numInputSteps_(0)
+    , numEvents_(0)
+  {
+    if(virtualDetectorIds_.empty()) {
+      throw cet::exception("BADCONFIG")<<"myPionStateProducer: virtualDetectorIds must not be empty\n";
+    }
+    if(particleTypes_.empty()) {
+      throw cet::exception("BADCONFIG")<<"myPionStateProducer: particleTypes must not be empty\n";
+    }
+    produces<StepPointMCCollection>();
+  }
+
+  //================================================================
+  void myPionStateProducer::produce(art::Event& event) {
+    const auto& steps = event.getProduct(stepPointMCsToken_);
+    std::unique_ptr<StepPointMCCollection> output(new StepPointMCCollection);
+
+    // Index in output of the saved step of each particle, for firstCrossingOnly.
+    std::map<art::Ptr<SimParticle>::key_type, unsigned> savedIndex;
+
+    for(const StepPointMC& step : steps) {
+      if(virtualDetectorIds_.find(step.volumeId()) == virtualDetectorIds_.end()) continue;
+      if(particleTypes_.find(step.simParticle()->pdgId()) == particleTypes_.end()) continue;
+      if(step.momentum().mag() < minMomentum_) continue;
+
+      if(firstCrossingOnly_) {
+        const auto res = savedIndex.insert(std::make_pair(step.simParticle().key(), unsigned(output->size())));
+        if(!res.second) {
+          StepPointMC& saved = (*output)[res.first->second];
+          if(step.time() < saved.time()) {
+            saved = step;
+          }
+          continue;
+        }
+      }
+
+      output->emplace_back(step);
+    }
+
+    for(const StepPointMC& step : *output) {
+      ++numSaved_[step.simParticle()->pdgId()];
+    }
+    numInputSteps_ += steps.size();
+    ++numEvents_;
+
+    if(verbosityLevel_ > 0) {
+      std::cout<<"myPionStateProducer: event "<<event.id()<<" saved "<<output->size()
+               <<" of "<<steps.size()<<" steps"<<std::endl;
+    }
+
+    event.put(std::move(output));
+  }
+
+  //================================================================
+  void myPionStateProducer::endJob() {
+    std::ostringstream os;
+    os<<"myPionStateProducer stats: events = "<<numEvents_<<", input steps = "<<numInputSteps_;
+    for(const auto& n : numSaved_) {
+      os<<"\n  PDG "<<n.first<<": "<<n.second<<" saved";
+    }
+    mf::LogInfo("Summary")<<os.str();
+  }
+
+  //================================================================
+
+} // namespace mu2e
+
+DEFINE_ART_MODULE(mu2e::myPionStateProducer)
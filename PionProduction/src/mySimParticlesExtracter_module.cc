@@ -1,5 +1,9 @@
 // Ntuple dumper for MCs.
 //
+// The layout parameter selects the flat "nt" tree with the parent fields
+// on every row, the normalized "particles" and "children" tables (see
+// SimParticleTables), or both.
+//
 // Andrei Gaponenko, 2013
 
 #include <string>
@@ -33,6 +37,10 @@
 #include "KinKal/General/ParticleState.hh"
 #include "Offline/MCDataProducts/inc/ExtMonFNALSimHit.hh"
 
+#include "PionProduction/inc/SimParticleAncestry.hh"
+#include "PionProduction/inc/SimParticleSelector.hh"
+#include "PionProduction/inc/SimParticleTables.hh"
+
 
 namespace mu2e {
 
@@ -107,6 +115,13 @@ namespace mu2e {
       using Name=fhicl::Name;
       using Comment=fhicl::Comment;
       fhicl::Atom<std::string> hits     {Name("hitsInputTag"     ), Comment("MC collection")};
+      fhicl::Table<SimParticleSelector::Config> selection{Name("selection"), Comment("Particle selection, see SimParticleSelector")};
+      fhicl::Atom<art::InputTag> physVolInfoInput{Name("physVolInfoInput"),
+          Comment("SubRun PhysicalVolumeInfoMultiCollection, used only by material cuts"), "g4run"};
+      fhicl::Atom<std::string> layout{Name("layout"),
+          Comment("Ntuple layout: \"flat\", \"normalized\" or \"both\", see SimParticleTables"), "flat"};
+      fhicl::Atom<bool> exportAncestry{Name("exportAncestry"),
+          Comment("Write the full ancestry of every row to the \"ancestry\" tree, see SimParticleAncestry"), false};
     };
 
     typedef art::EDAnalyzer::Table<Config> Parameters;
@@ -114,6 +129,15 @@ namespace mu2e {
   protected:
 
     art::InputTag hitsInputTag_;
+    art::InputTag physVolInfoInput_;
+    SimParticleSelector selector_;
+    bool writeFlat_;
+    bool writeNormalized_;
+    SimParticleTables::Writer tables_;
+    TTree *children_;
+    bool exportAncestry_;
+    SimParticleAncestry ancestry_;
+    int ancestryIndex_;
     TTree *nt_;
     SimuParticle hit_;
 
@@ -127,19 +151,47 @@ namespace mu2e {
   mySimParticlesExtracter::mySimParticlesExtracter(const Parameters& pset)
     : art::EDAnalyzer(pset)
       , hitsInputTag_(pset().hits())
+      , physVolInfoInput_(pset().physVolInfoInput())
+      , selector_(pset().selection())
+      , writeFlat_(pset().layout() != "normalized")
+      , writeNormalized_(pset().layout() != "flat")
+      , children_(0)
+      , exportAncestry_(pset().exportAncestry())
+      , ancestryIndex_(-1)
       , nt_(0)
   {
-
+    if(pset().layout() != "flat" && pset().layout() != "normalized" && pset().layout() != "both") {
+      throw cet::exception("BADCONFIG")<<"mySimParticlesExtracter: unknown layout \""<<pset().layout()
+                                       <<"\", expect flat, normalized or both\n";
+    }
   }
 
   //================================================================
   void mySimParticlesExtracter::beginJob() {
 
     art::ServiceHandle<art::TFileService> tfs;
-    static const char branchDesc[] = "RunID/I:SubRunID/I:EventID/L:ParticlePID/I:ParticleStartT/F:ParticleEndT/F:ParticleStartX/F:ParticleStartY/F:ParticleStartZ/F:ParticleEndX/F:ParticleEndY/F:ParticleEndZ/F:ParticleStartPx/F:ParticleStartPy/F:ParticleStartPz/F:ParentPID/I:ParentStartT/F:ParentEndT/F:ParentStartX/F:ParentStartY/F:ParentStartZ/F:ParentEndX/F:ParentEndY/F:ParentEndZ/F:ParentStartPx/F:ParentStartPy/F:ParentStartPz/F:ParentEndPx/F:ParentEndPy/F:ParentEndPz/F";
-
-    nt_ = tfs->make<TTree>( "nt", "SimuParticles ntuple");
-    nt_->Branch("hits", &hit_, branchDesc);
+    const std::string branchDesc = SimParticleTables::FlatRow::flatLeaves("Particle");
+
+    if(writeFlat_) {
+      nt_ = tfs->make<TTree>( "nt", "SimuParticles ntuple");
+      nt_->Branch("hits", &hit_, branchDesc.c_str());
+      if(exportAncestry_) {
+        nt_->Branch("AncestryIndex", &ancestryIndex_, "AncestryIndex/I");
+      }
+    }
+
+    if(writeNormalized_) {
+      tables_.book(tfs->make<TTree>("particles", "Selected SimParticles and their parents"));
+      children_ = tfs->make<TTree>("children", "Selected SimParticle to parent keys");
+      tables_.bookChildren(children_);
+      if(exportAncestry_) {
+        children_->Branch("AncestryIndex", &ancestryIndex_, "AncestryIndex/I");
+      }
+    }
+
+    if(exportAncestry_) {
+      ancestry_.book(tfs->make<TTree>("ancestry", "SimParticle ancestry of the ntuple rows"));
+    }
   }
 
   //================================================================
@@ -147,12 +199,16 @@ namespace mu2e {
   void mySimParticlesExtracter::analyze(const art::Event& event) {
 
     const auto& ih = event.getValidHandle<SimParticleCollection>(hitsInputTag_);
+    selector_.updateVolumes(event.getSubRun(), physVolInfoInput_);
+    ancestry_.clear();
+    tables_.beginEvent(event.run(), event.subRun(), event.event());
 
     art::Ptr<SimParticle> Parent;
 
     for(const auto& i : *ih) 
    {
          const SimParticle& particle = i.second;
+         if(!selector_.accept(particle)) continue;
 
         if(particle.hasParent())
        {	   
@@ -161,16 +217,28 @@ namespace mu2e {
            //Parent->startPosition().x()<<", "<<Parent->startPosition().y()<<", "<<Parent->startPosition().z()<<") " << Parent->startGlobalTime() <<
            //std::endl; 
 
-           hit_ = SimuParticle(event.run(), event.subRun(), event.event(), particle);
+           if(exportAncestry_) {
+             ancestryIndex_ = ancestry_.addChain(ih.id(), *ih, particle);
+           }
 
            //std::cout<<"Parent : "<<hit_.ParentPID<<", ("<<
            //hit_.ParentStartX<<", "<<hit_.ParentStartY<<", "<<hit_.ParentStartZ<<") " << hit_.ParentStartT<<
            //std::endl;
 
-           nt_->Fill();
+           if(writeFlat_) {
+             hit_ = SimuParticle(event.run(), event.subRun(), event.event(), particle);
+             nt_->Fill();
+           }
+           if(writeNormalized_) {
+             tables_.add(particle, children_);
+           }
        } 
 
    }
+
+    if(exportAncestry_) {
+      ancestry_.fill(event.run(), event.subRun(), event.event());
+    }
  }
 
   //================================================================
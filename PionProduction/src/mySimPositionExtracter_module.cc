@@ -1,11 +1,21 @@
 // Ntuple dumper for MCs.
 //
+// With a regions list each particle is located among the configured boxes
+// (start position, or end position with useEndPosition) through a
+// RegionGrid, particles outside all regions are dropped, and the region is
+// written as a RegionID column or, with perRegionTrees, selects the tree
+// nt_<name> the row goes to.  Without regions, and unless the selection
+// has its own startRegions, only particles starting in the box around the
+// production target are written, as before the selection was configurable.
+//
 // Andrei Gaponenko, 2013
 
 #include <string>
 #include <vector>
 #include <limits>
 #include <cmath>
+#include <set>
+#include <sstream>
 
 #include "cetlib_except/exception.h"
 #include "CLHEP/Vector/ThreeVector.h"
@@ -20,10 +30,12 @@
 #include "art/Framework/Core/EDAnalyzer.h"
 #include "fhiclcpp/types/Atom.h"
 #include "fhiclcpp/types/OptionalSequence.h"
+#include "fhiclcpp/types/Sequence.h"
 #include "art/Framework/Principal/Event.h"
 #include "art/Framework/Principal/Run.h"
 #include "art/Framework/Principal/Provenance.h"
 #include "art_root_io/TFileService.h"
+#include "messagefacility/MessageLogger/MessageLogger.h"
 
 #include "Offline/GlobalConstantsService/inc/GlobalConstantsHandle.hh"
 #include "Offline/GlobalConstantsService/inc/ParticleDataList.hh"
@@ -34,6 +46,9 @@
 #include "KinKal/General/ParticleState.hh"
 #include "Offline/MCDataProducts/inc/ExtMonFNALSimHit.hh"
 
+#include "PionProduction/inc/RegionGrid.hh"
+#include "PionProduction/inc/SimParticleSelector.hh"
+
 
 namespace mu2e {
 
@@ -69,10 +84,31 @@ namespace mu2e {
 
   //================================================================
   class mySimPositionIDExtracter : public art::EDAnalyzer {
+    struct Region {
+      using Name=fhicl::Name;
+      using Comment=fhicl::Comment;
+      fhicl::Atom<int> id{Name("id"), Comment("Value of the RegionID column")};
+      fhicl::Atom<std::string> name{Name("name"), Comment("Region name, the per-region tree is nt_<name>")};
+      fhicl::Sequence<double,3> low{Name("low"), Comment("Lower (x, y, z) corner, mm")};
+      fhicl::Sequence<double,3> high{Name("high"), Comment("Upper (x, y, z) corner, mm")};
+    };
+
     struct Config {
       using Name=fhicl::Name;
       using Comment=fhicl::Comment;
       fhicl::Atom<std::string> hits     {Name("hitsInputTag"     ), Comment("MC collection")};
+      fhicl::Table<SimParticleSelector::Config> selection{Name("selection"), Comment("Particle selection, see SimParticleSelector")};
+      fhicl::Atom<art::InputTag> physVolInfoInput{Name("physVolInfoInput"),
+          Comment("SubRun PhysicalVolumeInfoMultiCollection, used only by material cuts"), "g4run"};
+      fhicl::Sequence<fhicl::Table<Region> > regions{Name("regions"),
+          Comment("Regions of interest, the first listed wins where they overlap.\n"
+                  "If empty all selected particles are written without a RegionID."), std::vector<Region>{}};
+      fhicl::Atom<bool> useEndPosition{Name("useEndPosition"),
+          Comment("Locate particles by their end instead of start position"), false};
+      fhicl::Atom<bool> perRegionTrees{Name("perRegionTrees"),
+          Comment("Write one tree per region instead of a RegionID column"), false};
+      fhicl::Atom<unsigned> gridDivisions{Name("gridDivisions"),
+          Comment("Cells per axis of the region grid, 0 for automatic"), 0};
     };
 
     typedef art::EDAnalyzer::Table<Config> Parameters;
@@ -80,9 +116,20 @@ namespace mu2e {
   protected:
 
     art::InputTag hitsInputTag_;
+    art::InputTag physVolInfoInput_;
+    SimParticleSelector selector_;
     TTree *nt_;
     SimuParticle hit_;
 
+    std::vector<int> regionIds_;
+    std::vector<std::string> regionNames_;
+    RegionGrid grid_;
+    bool useEndPosition_;
+    bool perRegionTrees_;
+    std::vector<TTree*> regionTrees_;
+    std::vector<unsigned long> regionCounts_;
+    int regionId_;
+
     public:
     explicit mySimPositionIDExtracter(const Parameters& pset);
     virtual void beginJob();
@@ -94,8 +141,38 @@ namespace mu2e {
   mySimPositionIDExtracter::mySimPositionIDExtracter(const Parameters& pset)
     : art::EDAnalyzer(pset)
       , hitsInputTag_(pset().hits())
+      , physVolInfoInput_(pset().physVolInfoInput())
       , nt_(0)
+      , useEndPosition_(pset().useEndPosition())
+      , perRegionTrees_(pset().perRegionTrees())
+      , regionId_(-1)
   {
+    std::vector<RegionGrid::Box> boxes;
+    std::set<std::string> names;
+    for(const auto& r : pset().regions()) {
+      RegionGrid::Box b;
+      for(unsigned i=0; i<3; ++i) { b.low[i] = r.low()[i]; b.high[i] = r.high()[i]; }
+      boxes.push_back(b);
+      regionIds_.push_back(r.id());
+      regionNames_.push_back(r.name());
+      if(!names.insert(r.name()).second) {
+        throw cet::exception("BADCONFIG")<<"mySimPositionIDExtracter: duplicate region name "<<r.name()<<"\n";
+      }
+    }
+    grid_ = RegionGrid(boxes, pset().gridDivisions());
+    regionCounts_.assign(boxes.size(), 0);
+
+    if(perRegionTrees_ && boxes.empty()) {
+      throw cet::exception("BADCONFIG")<<"mySimPositionIDExtracter: perRegionTrees requires regions\n";
+    }
+
+    // Without regions the production target box is the default start
+    // region, whatever other cuts are given
+    SimParticleSelector::Settings selection = SimParticleSelector::settings(pset().selection());
+    if(boxes.empty() && selection.startRegions.empty()) {
+      selection.startRegions.push_back(SimParticleSelector::Settings::Region{{3850., -20., -6300.}, {3950., 20., -6000.}});
+    }
+    selector_ = SimParticleSelector(selection);
   }
 
   //================================================================
@@ -103,8 +180,20 @@ namespace mu2e {
     art::ServiceHandle<art::TFileService> tfs;
     static const char branchDesc[] = "ParentPID/I:ParticlePID/I:StartVolumeID/i:EndVolumeID/i:ParticleStartX/F:ParticleStartY/F:ParticleStartZ/F:ParticleEndX/F:ParticleEndY/F:ParticleEndZ/F";
 
+    if(perRegionTrees_) {
+      for(unsigned i = 0; i < regionNames_.size(); ++i) {
+        regionTrees_.push_back(tfs->make<TTree>(("nt_" + regionNames_[i]).c_str(),
+                                                ("SimuParticles ntuple, region " + regionNames_[i]).c_str()));
+        regionTrees_.back()->Branch("hits", &hit_, branchDesc);
+      }
+      return;
+    }
+
     nt_ = tfs->make<TTree>( "nt", "SimuParticles ntuple");
     nt_->Branch("hits", &hit_, branchDesc);
+    if(grid_.size() > 0) {
+      nt_->Branch("RegionID", &regionId_, "RegionID/I");
+    }
 
   }
 
@@ -113,23 +202,30 @@ namespace mu2e {
   void mySimPositionIDExtracter::analyze(const art::Event& event) {
 
     const auto& ih = event.getValidHandle<SimParticleCollection>(hitsInputTag_);
+    selector_.updateVolumes(event.getSubRun(), physVolInfoInput_);
 
     art::Ptr<SimParticle> Parent;
 
-    float X, Y, Z;
     for(const auto& i : *ih) 
    {
        const SimParticle& particle = i.second;
 
-       X=particle.startPosition().x();
-       Y=particle.startPosition().y();
-       Z=particle.startPosition().z();
-
-       if(Z>-6300 && Z<-6000 && X<3950 && X>3850 && Y>-20 && Y<20)
+       if(selector_.accept(particle))
       {
+          int region = -1;
+          if(grid_.size() > 0) {
+            const CLHEP::Hep3Vector& pos = useEndPosition_ ? particle.endPosition() : particle.startPosition();
+            region = grid_.find(pos.x(), pos.y(), pos.z());
+            if(region < 0) continue;
+            ++regionCounts_[region];
+            regionId_ = regionIds_[region];
+          }
+
        	  if(!particle.hasParent()) hit_ = SimuParticle(0, particle) ;
     	  else hit_ = SimuParticle(particle.parent()->pdgId(), particle);
-          nt_->Fill();
+
+          if(perRegionTrees_) regionTrees_[region]->Fill();
+          else nt_->Fill();
        }
    }
  }
@@ -138,6 +234,16 @@ namespace mu2e {
 
 void mySimPositionIDExtracter::endJob() {
 
+   if (grid_.size() > 0) {
+     std::ostringstream os;
+     os<<"mySimPositionIDExtracter: "<<grid_.size()<<" regions, "<<grid_.cells()<<" grid cells, "
+       <<grid_.meanCandidates()<<" candidates per cell";
+     for (unsigned i = 0; i < regionNames_.size(); ++i) {
+       os<<"\n  "<<regionNames_[i]<<" (ID "<<regionIds_[i]<<"): "<<regionCounts_[i];
+     }
+     mf::LogInfo("Summary")<<os.str();
+   }
+
    if (nt_) {
     TFile* f = nt_->GetCurrentFile();
     if (f) {
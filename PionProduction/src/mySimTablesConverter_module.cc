@@ -0,0 +1,197 @@
+// Converts existing SimParticle ntuples between the flat layout of
+// mySimParticlesExtracter (SimuParticle) and myStoppedParticlesFinder
+// (MuonStop) and the normalized particles/children layout, see
+// SimParticleTables.
+//
+// The conversion is done in beginJob from inputFile; the job needs no
+// events (source EmptyEvent with maxEvents 0).  With direction
+// "normalize" the "hits" branch of flatTree is read and the "particles"
+// and "children" trees are written; with "flatten" the particles and
+// children trees are joined and the flat "nt" tree is written.  The
+// output goes to the TFileService file.
+
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "cetlib_except/exception.h"
+
+#include "TFile.h"
+#include "TTree.h"
+
+#include "art/Framework/Core/EDAnalyzer.h"
+#include "fhiclcpp/types/Atom.h"
+#include "art/Framework/Principal/Event.h"
+#include "art_root_io/TFileService.h"
+#include "messagefacility/MessageLogger/MessageLogger.h"
+
+#include "PionProduction/inc/SimParticleTables.hh"
+
+namespace mu2e {
+
+  //================================================================
+  class mySimTablesConverter : public art::EDAnalyzer {
+    struct Config {
+      using Name=fhicl::Name;
+      using Comment=fhicl::Comment;
+      fhicl::Atom<std::string> inputFile{Name("inputFile"), Comment("ROOT file with the ntuples to convert")};
+      fhicl::Atom<std::string> direction{Name("direction"), Comment("normalize (flat to particles/children) or flatten")};
+      fhicl::Atom<std::string> particlePrefix{Name("particlePrefix"),
+          Comment("Prefix of the particle fields of the flat layout: Particle for SimuParticle, Muon for MuonStop"), "Particle"};
+      fhicl::Atom<std::string> flatTree{Name("flatTree"), Comment("Flat tree in inputFile"), "PionProduction/nt"};
+      fhicl::Atom<std::string> particlesTree{Name("particlesTree"), Comment("Particles tree in inputFile"), "PionProduction/particles"};
+      fhicl::Atom<std::string> childrenTree{Name("childrenTree"), Comment("Children tree in inputFile"), "PionProduction/children"};
+    };
+
+    typedef art::EDAnalyzer::Table<Config> Parameters;
+
+  public:
+    explicit mySimTablesConverter(const Parameters& pset);
+    void beginJob() override;
+    void analyze(const art::Event&) override {}
+
+  private:
+    std::string inputFile_;
+    bool normalize_;
+    std::string particlePrefix_;
+    std::string flatTree_;
+    std::string particlesTree_;
+    std::string childrenTree_;
+
+    TTree* getTree(TFile& file, const std::string& name) const;
+    void normalize(TFile& file);
+    void flatten(TFile& file);
+  };
+
+  //================================================================
+  mySimTablesConverter::mySimTablesConverter(const Parameters& pset)
+    : art::EDAnalyzer(pset)
+    , inputFile_(pset().inputFile())
+    , normalize_(pset().direction() == "normalize")
+    , particlePrefix_(pset().particlePrefix())
+    , flatTree_(pset().flatTree())
+    , particlesTree_(pset().particlesTree())
+    , childrenTree_(pset().childrenTree())
+  {
+    if(!normalize_ && pset().direction() != "flatten") {
+      throw cet::exception("BADCONFIG")<<"mySimTablesConverter: unknown direction \""<<pset().direction()
+                                       <<"\", expected normalize or flatten\n";
+    }
+  }
+
+  //================================================================
+  TTree* mySimTablesConverter::getTree(TFile& file, const std::string& name) const {
+    TTree* tree = dynamic_cast<TTree*>(file.Get(name.c_str()));
+    if(!tree) {
+      throw cet::exception("BADINPUT")<<"mySimTablesConverter: no tree "<<name<<" in "<<inputFile_<<"\n";
+    }
+    return tree;
+  }
+
+  //================================================================
+  void mySimTablesConverter::beginJob() {
+    std::unique_ptr<TFile> file(TFile::Open(inputFile_.c_str()));
+    if(!file || file->IsZombie()) {
+      throw cet::exception("BADINPUT")<<"mySimTablesConverter: can not open "<<inputFile_<<"\n";
+    }
+    if(normalize_) {
+      normalize(*file);
+    }
+    else {
+      flatten(*file);
+    }
+  }
+
+  //================================================================
+  void mySimTablesConverter::normalize(TFile& file) {
+    TTree* in = getTree(file, flatTree_);
+    SimParticleTables::FlatRow row;
+    if(!in->GetBranch("hits") || in->GetBranch("hits")->GetTitle() != SimParticleTables::FlatRow::flatLeaves(particlePrefix_)) {
+      throw cet::exception("BADINPUT")<<"mySimTablesConverter: "<<flatTree_<<" has no \"hits\" branch with leaves "
+                                      <<SimParticleTables::FlatRow::flatLeaves(particlePrefix_)<<"\n";
+    }
+    in->SetBranchAddress("hits", &row);
+
+    std::vector<SimParticleTables::FlatRow> rows;
+    rows.reserve(in->GetEntries());
+    for(Long64_t i = 0; i < in->GetEntries(); ++i) {
+      in->GetEntry(i);
+      rows.push_back(row);
+    }
+    in->ResetBranchAddresses();
+
+    std::vector<SimParticleTables::ParticleRow> particles;
+    std::vector<SimParticleTables::ChildRow> children;
+    SimParticleTables::normalize(rows, particles, children);
+
+    art::ServiceHandle<art::TFileService> tfs;
+    SimParticleTables::ParticleRow particle;
+    TTree* pt = tfs->make<TTree>("particles", "SimParticles and their parents");
+    pt->Branch("particles", &particle, SimParticleTables::ParticleRow::leaves());
+    for(const auto& p : particles) {
+      particle = p;
+      pt->Fill();
+    }
+
+    SimParticleTables::ChildRow child;
+    TTree* ct = tfs->make<TTree>("children", "SimParticle to parent keys");
+    ct->Branch("children", &child, SimParticleTables::ChildRow::leaves());
+    for(const auto& c : children) {
+      child = c;
+      ct->Fill();
+    }
+
+    mf::LogInfo("Summary")<<"mySimTablesConverter: "<<rows.size()<<" flat rows of "<<flatTree_
+                          <<" to "<<particles.size()<<" particles and "<<children.size()<<" children";
+  }
+
+  //================================================================
+  void mySimTablesConverter::flatten(TFile& file) {
+    typedef std::tuple<int, int, long long, unsigned> ParticleID;
+
+    TTree* pin = getTree(file, particlesTree_);
+    SimParticleTables::ParticleRow particle;
+    pin->SetBranchAddress("particles", &particle);
+    std::map<ParticleID, SimParticleTables::ParticleRow> particles;
+    for(Long64_t i = 0; i < pin->GetEntries(); ++i) {
+      pin->GetEntry(i);
+      particles[ParticleID(particle.RunID, particle.SubRunID, particle.EventID, particle.Key)] = particle;
+    }
+    pin->ResetBranchAddresses();
+
+    art::ServiceHandle<art::TFileService> tfs;
+    SimParticleTables::FlatRow row;
+    TTree* out = tfs->make<TTree>("nt", "SimParticle ntuple");
+    out->Branch("hits", &row, SimParticleTables::FlatRow::flatLeaves(particlePrefix_).c_str());
+
+    TTree* cin = getTree(file, childrenTree_);
+    SimParticleTables::ChildRow child;
+    cin->SetBranchAddress("children", &child);
+    unsigned long missing = 0;
+    for(Long64_t i = 0; i < cin->GetEntries(); ++i) {
+      cin->GetEntry(i);
+      const auto ip = particles.find(ParticleID(child.RunID, child.SubRunID, child.EventID, child.Key));
+      const auto iq = particles.find(ParticleID(child.RunID, child.SubRunID, child.EventID, child.ParentKey));
+      if(ip == particles.end() || iq == particles.end()) {
+        ++missing;
+        continue;
+      }
+      row = SimParticleTables::flatten(ip->second, iq->second);
+      out->Fill();
+    }
+    cin->ResetBranchAddresses();
+
+    if(missing > 0) {
+      throw cet::exception("BADINPUT")<<"mySimTablesConverter: "<<missing<<" children of "<<childrenTree_
+                                      <<" without their particle or parent in "<<particlesTree_<<"\n";
+    }
+
+    mf::LogInfo("Summary")<<"mySimTablesConverter: "<<particles.size()<<" particles and "<<cin->GetEntries()
+                          <<" children to "<<out->GetEntries()<<" flat rows";
+  }
+
+} // namespace mu2e
+
+DEFINE_ART_MODULE(mu2e::mySimTablesConverter)
@@ -1,5 +1,9 @@
 // Ntuple dumper for MCs.
 //
+// With aggregate set the per-particle ntuple is replaced by a count matrix
+// of (StartVolumeID, EndVolumeID) pairs accumulated over the job and written at
+// endJob as the "volumeFlow" table and histogram, see PairCountMap.
+//
 // Andrei Gaponenko, 2013
 
 #include <string>
@@ -24,6 +28,7 @@
 #include "art/Framework/Principal/Run.h"
 #include "art/Framework/Principal/Provenance.h"
 #include "art_root_io/TFileService.h"
+#include "messagefacility/MessageLogger/MessageLogger.h"
 
 #include "Offline/GlobalConstantsService/inc/GlobalConstantsHandle.hh"
 #include "Offline/GlobalConstantsService/inc/ParticleDataList.hh"
@@ -34,6 +39,9 @@
 #include "KinKal/General/ParticleState.hh"
 #include "Offline/MCDataProducts/inc/ExtMonFNALSimHit.hh"
 
+#include "PionProduction/inc/PairCountMap.hh"
+#include "PionProduction/inc/SimParticleSelector.hh"
+
 
 namespace mu2e {
 
@@ -62,6 +70,13 @@ namespace mu2e {
       using Name=fhicl::Name;
       using Comment=fhicl::Comment;
       fhicl::Atom<std::string> hits     {Name("hitsInputTag"     ), Comment("MC collection")};
+      fhicl::Table<SimParticleSelector::Config> selection{Name("selection"), Comment("Particle selection, see SimParticleSelector")};
+      fhicl::Atom<art::InputTag> physVolInfoInput{Name("physVolInfoInput"),
+          Comment("SubRun PhysicalVolumeInfoMultiCollection, used only by material cuts"), "g4run"};
+      fhicl::Atom<bool> aggregate{Name("aggregate"),
+          Comment("Count (StartVolumeID, EndVolumeID) pairs over the job instead of writing the ntuple"), false};
+      fhicl::Atom<unsigned> maxHistogramBins{Name("maxHistogramBins"),
+          Comment("Write the aggregated counts also as a TH2D if each axis has at most this many distinct values"), 500};
     };
 
     typedef art::EDAnalyzer::Table<Config> Parameters;
@@ -69,6 +84,11 @@ namespace mu2e {
   protected:
 
     art::InputTag hitsInputTag_;
+    art::InputTag physVolInfoInput_;
+    SimParticleSelector selector_;
+    bool aggregate_;
+    unsigned maxHistogramBins_;
+    PairCountMap counts_;
     TTree *nt_;
     SimuParticle hit_;
 
@@ -83,12 +103,20 @@ namespace mu2e {
   mySimVolumeIDExtracter::mySimVolumeIDExtracter(const Parameters& pset)
     : art::EDAnalyzer(pset)
       , hitsInputTag_(pset().hits())
+      , physVolInfoInput_(pset().physVolInfoInput())
+      , selector_(pset().selection())
+      , aggregate_(pset().aggregate())
+      , maxHistogramBins_(pset().maxHistogramBins())
       , nt_(0)
   {
   }
 
   //================================================================
   void mySimVolumeIDExtracter::beginJob() {
+    if(aggregate_) {
+      return;
+    }
+
     art::ServiceHandle<art::TFileService> tfs;
     static const char branchDesc[] = "ParentPID/I:ParticlePID/I:StartVolumeID/i:EndVolumeID/i";
 
@@ -102,12 +130,19 @@ namespace mu2e {
   void mySimVolumeIDExtracter::analyze(const art::Event& event) {
 
     const auto& ih = event.getValidHandle<SimParticleCollection>(hitsInputTag_);
+    selector_.updateVolumes(event.getSubRun(), physVolInfoInput_);
 
     art::Ptr<SimParticle> Parent;
 
     for(const auto& i : *ih) 
    {
          const SimParticle& particle = i.second;
+         if(!selector_.accept(particle)) continue;
+
+        if(aggregate_) {
+          counts_.increment(particle.startVolumeIndex(), particle.endVolumeIndex());
+          continue;
+        }
 
         if(!particle.hasParent()) hit_ = SimuParticle(0, particle.pdgId(), particle.startVolumeIndex(), particle.endVolumeIndex() ) ;
 	else hit_ = SimuParticle(particle.parent()->pdgId(), particle.pdgId(), particle.startVolumeIndex(), particle.endVolumeIndex() );
@@ -125,6 +160,14 @@ namespace mu2e {
 
 void mySimVolumeIDExtracter::endJob() {
 
+   if (aggregate_) {
+     art::ServiceHandle<art::TFileService> tfs;
+     writePairCounts(counts_, *tfs, "volumeFlow", "Start volume to end volume", "StartVolumeID", "EndVolumeID", maxHistogramBins_);
+     mf::LogInfo("Summary")<<"mySimVolumeIDExtracter: "<<counts_.total()<<" particles in "
+                           <<counts_.size()<<" non-zero (StartVolumeID, EndVolumeID) cells";
+     return;
+   }
+
    if (nt_) {
     TFile* f = nt_->GetCurrentFile();
     if (f) {
@@ -0,0 +1,202 @@
+// Drop the resampled pion and muon states that are unlikely to stop,
+// before they are given to Mu2eG4, using a StopAcceptanceMap learned by
+// myStopAcceptanceMapBuilder.
+//
+// States in cells with a stop probability below killThreshold are
+// dropped.  If every remaining state of the event is below
+// rouletteThreshold the event plays Russian roulette: it is kept with
+// probability rouletteSurvival and then carries an EventWeight of
+// 1/rouletteSurvival, otherwise the weight is 1.  States outside the map
+// or in cells with fewer than minStates learned states are always kept.
+// Events without remaining states are rejected.
+//
+// Dropping states is a biased cut, killThreshold should only remove the
+// cells that essentially never stop; the roulette is unbiased when the
+// EventWeight is used.
+
+#include <string>
+#include <memory>
+#include <sstream>
+
+#include "cetlib_except/exception.h"
+
+#include "messagefacility/MessageLogger/MessageLogger.h"
+
+#include "fhiclcpp/types/Atom.h"
+#include "canvas/Utilities/InputTag.h"
+
+#include "CLHEP/Random/RandFlat.h"
+
+#include "art/Framework/Core/EDFilter.h"
+#include "art/Framework/Principal/Event.h"
+#include "art/Framework/Principal/Handle.h"
+#include "art/Framework/Services/Registry/ServiceHandle.h"
+
+#include "TFile.h"
+
+// Mu2e includes.
+#include "Offline/ConfigTools/inc/ConfigFileLookupPolicy.hh"
+#include "Offline/SeedService/inc/SeedService.hh"
+#include "Offline/MCDataProducts/inc/EventWeight.hh"
+#include "Offline/MCDataProducts/inc/SimParticle.hh"
+#include "Offline/MCDataProducts/inc/StepPointMC.hh"
+
+#include "PionProduction/inc/StopAcceptanceMap.hh"
+
+namespace mu2e {
+
+  //================================================================
+  class myStopAcceptanceCut : public art::EDFilter {
+    public:
+      struct Config {
+        using Name=fhicl::Name;
+        using Comment=fhicl::Comment;
+
+        fhicl::Atom<art::InputTag> statesTag{ Name("statesTag"),
+          Comment("Resampled states StepPointMCs")
+        };
+
+        fhicl::Atom<std::string> mapFile{ Name("mapFile"),
+          Comment("File written by myStopAcceptanceMapBuilder")
+        };
+
+        fhicl::Atom<std::string> mapName{ Name("mapName"),
+          Comment("Path of the map in mapFile, see StopAcceptanceMap"), "stopAcceptanceMapBuilder/stopAcceptance"
+        };
+
+        fhicl::Atom<double> minStates{ Name("minStates"),
+          Comment("Cells learned from fewer states are not cut on"), 100.
+        };
+
+        fhicl::Atom<double> killThreshold{ Name("killThreshold"),
+          Comment("States with a stop probability below this are dropped"), 0.
+        };
+
+        fhicl::Atom<double> rouletteThreshold{ Name("rouletteThreshold"),
+          Comment("Events whose states are all below this play Russian roulette"), 0.
+        };
+
+        fhicl::Atom<double> rouletteSurvival{ Name("rouletteSurvival"),
+          Comment("Survival probability of the Russian roulette"), 1.
+        };
+      };
+
+      using Parameters = art::EDFilter::Table<Config>;
+      explicit myStopAcceptanceCut(const Parameters& conf);
+
+      void beginJob() override;
+      bool filter(art::Event& evt) override;
+      void endJob() override;
+
+    private:
+      art::ProductToken<StepPointMCCollection> statesToken_;
+      std::string mapFile_;
+      std::string mapName_;
+      double minStates_;
+      double killThreshold_;
+      double rouletteThreshold_;
+      double rouletteSurvival_;
+
+      CLHEP::RandFlat randFlat_;
+      StopAcceptanceMap map_;
+
+      unsigned long numStates_;
+      unsigned long numKilled_;
+      unsigned long numEvents_;
+      unsigned long numRouletted_;
+      unsigned long numSurvived_;
+      unsigned long numPassed_;
+  };
+
+  //================================================================
+  myStopAcceptanceCut::myStopAcceptanceCut(const Parameters& conf)
+    : art::EDFilter{conf}
+    , statesToken_(consumes<StepPointMCCollection>(conf().statesTag()))
+    , mapFile_(conf().mapFile())
+    , mapName_(conf().mapName())
+    , minStates_(conf().minStates())
+    , killThreshold_(conf().killThreshold())
+    , rouletteThreshold_(conf().rouletteThreshold())
+    , rouletteSurvival_(conf().rouletteSurvival())
+    , randFlat_(createEngine(art::ServiceHandle<SeedService>()->getSeed()))
+    , numStates_(0)
+    , numKilled_(0)
+    , numEvents_(0)
+    , numRouletted_(0)
+    , numSurvived_(0)
+    , numPassed_(0)
+  {
+    if(!(rouletteSurvival_ > 0. && rouletteSurvival_ <= 1.)) {
+      throw cet::exception("BADCONFIG")<<"myStopAcceptanceCut: rouletteSurvival must be in (0, 1]\n";
+    }
+    produces<StepPointMCCollection>();
+    produces<EventWeight>();
+  }
+
+  //================================================================
+  void myStopAcceptanceCut::beginJob() {
+    ConfigFileLookupPolicy findConfig;
+    const std::string fileName = findConfig(mapFile_);
+    std::unique_ptr<TFile> f(TFile::Open(fileName.c_str(), "READ"));
+    if(!f || f->IsZombie()) {
+      throw cet::exception("BADCONFIG")<<"myStopAcceptanceCut: can not open mapFile "<<fileName<<"\n";
+    }
+    map_ = StopAcceptanceMap::read(*f, mapName_);
+    mf::LogInfo("Info")<<"myStopAcceptanceCut: read "<<map_.size()<<" cells of "<<mapName_<<" from "<<fileName;
+  }
+
+  //================================================================
+  bool myStopAcceptanceCut::filter(art::Event& event) {
+    const auto& states = event.getProduct(statesToken_);
+    std::unique_ptr<StepPointMCCollection> output(new StepPointMCCollection);
+
+    ++numEvents_;
+    bool belowRoulette = true;
+    for(const StepPointMC& step : states) {
+      const int cell = map_.cell(step.simParticle()->pdgId(), step.position(), step.momentum());
+      const double p = (cell < 0) ? -1. : map_.probability(cell, minStates_);
+      if(p >= 0. && p < killThreshold_) {
+        ++numKilled_;
+        continue;
+      }
+      if(p < 0. || p >= rouletteThreshold_) {
+        belowRoulette = false;
+      }
+      output->emplace_back(step);
+    }
+    numStates_ += states.size();
+
+    double weight = 1.;
+    bool passed = !output->empty();
+    if(passed && belowRoulette && rouletteSurvival_ < 1.) {
+      ++numRouletted_;
+      if(randFlat_.fire() < rouletteSurvival_) {
+        ++numSurvived_;
+        weight = 1./rouletteSurvival_;
+      }
+      else {
+        output->clear();
+        passed = false;
+      }
+    }
+
+    if(passed) ++numPassed_;
+    event.put(std::move(output));
+    event.put(std::make_unique<EventWeight>(weight));
+    return passed;
+  }
+
+  //================================================================
+  void myStopAcceptanceCut::endJob() {
+    std::ostringstream os;
+    os<<"myStopAcceptanceCut stats: killed "<<numKilled_<<" of "<<numStates_<<" states, "
+      <<numSurvived_<<" of "<<numRouletted_<<" rouletted events survived, passed "
+      <<numPassed_<<" of "<<numEvents_<<" events";
+    mf::LogInfo("Summary")<<os.str();
+  }
+
+  //================================================================
+
+} // namespace mu2e
+
+DEFINE_ART_MODULE(mu2e::myStopAcceptanceCut)
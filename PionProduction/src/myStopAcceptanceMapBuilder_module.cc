@@ -0,0 +1,168 @@
+// Learn the stop probability of the resampled pion and muon states of
+// the second production stage, see StopAcceptanceMap.  Each state is
+// counted once, as stopped if any of the selected stops descends from its
+// particle.  Run on a production without myStopAcceptanceCut, the map is
+// written at endJob for use by myStopAcceptanceCut.
+
+#include <string>
+#include <vector>
+#include <map>
+#include <sstream>
+
+#include "messagefacility/MessageLogger/MessageLogger.h"
+
+#include "fhiclcpp/types/Atom.h"
+#include "fhiclcpp/types/Sequence.h"
+#include "canvas/Utilities/InputTag.h"
+
+#include "art/Framework/Core/EDAnalyzer.h"
+#include "art/Framework/Principal/Event.h"
+#include "art/Framework/Principal/Handle.h"
+#include "art/Framework/Services/Registry/ServiceHandle.h"
+#include "art_root_io/TFileService.h"
+
+// Mu2e includes.
+#include "Offline/MCDataProducts/inc/SimParticle.hh"
+#include "Offline/MCDataProducts/inc/SimParticlePtrCollection.hh"
+#include "Offline/MCDataProducts/inc/StepPointMC.hh"
+
+#include "PionProduction/inc/StopAcceptanceMap.hh"
+
+namespace mu2e {
+
+  //================================================================
+  class myStopAcceptanceMapBuilder : public art::EDAnalyzer {
+    public:
+      struct Config {
+        using Name=fhicl::Name;
+        using Comment=fhicl::Comment;
+
+        fhicl::Atom<art::InputTag> statesTag{ Name("statesTag"),
+          Comment("Resampled states, the Mu2eG4 primary StepPointMCs")
+        };
+
+        fhicl::Atom<art::InputTag> stopsTag{ Name("stopsTag"),
+          Comment("Selected stops, the myStoppedParticlesFinder output")
+        };
+
+        fhicl::Atom<std::string> mapName{ Name("mapName"),
+          Comment("Name of the written map, see StopAcceptanceMap"), "stopAcceptance"
+        };
+
+        fhicl::Sequence<int> pdgIds{ Name("pdgIds"),
+          Comment("Species of the map"), std::vector<int>{ 211, -211, 13, -13 }
+        };
+
+        fhicl::Sequence<double,3> axisPoint{ Name("axisPoint"),
+          Comment("A point on the reference axis, mm")
+        };
+
+        fhicl::Sequence<double,3> axisDirection{ Name("axisDirection"),
+          Comment("Direction of the reference axis")
+        };
+
+        fhicl::Atom<unsigned> radiusBins{ Name("radiusBins"), Comment("Bins in distance from the axis") };
+        fhicl::Atom<double> maxRadius{ Name("maxRadius"), Comment("Upper edge of the distance bins, mm") };
+
+        fhicl::Atom<unsigned> momentumBins{ Name("momentumBins"), Comment("Bins in momentum") };
+        fhicl::Sequence<double,2> momentumRange{ Name("momentumRange"), Comment("[min, max] momentum, MeV/c") };
+
+        fhicl::Atom<unsigned> cosThetaBins{ Name("cosThetaBins"), Comment("Bins in the cosine of the angle to the axis") };
+      };
+
+      using Parameters = art::EDAnalyzer::Table<Config>;
+      explicit myStopAcceptanceMapBuilder(const Parameters& conf);
+
+      void analyze(const art::Event& evt) override;
+      void endJob() override;
+
+    private:
+      art::InputTag statesTag_;
+      art::InputTag stopsTag_;
+      std::string mapName_;
+      StopAcceptanceMap map_;
+
+      unsigned long numStates_;
+      unsigned long numStopped_;
+      unsigned long numOutside_;
+
+      static StopAcceptanceMap::Binning binning(const Config& conf);
+  };
+
+  //================================================================
+  StopAcceptanceMap::Binning myStopAcceptanceMapBuilder::binning(const Config& conf) {
+    StopAcceptanceMap::Binning b;
+    b.pdgIds = conf.pdgIds();
+    b.axisPoint.set(conf.axisPoint()[0], conf.axisPoint()[1], conf.axisPoint()[2]);
+    b.axisDirection.set(conf.axisDirection()[0], conf.axisDirection()[1], conf.axisDirection()[2]);
+    b.radiusBins = conf.radiusBins();
+    b.maxRadius = conf.maxRadius();
+    b.momentumBins = conf.momentumBins();
+    b.minMomentum = conf.momentumRange()[0];
+    b.maxMomentum = conf.momentumRange()[1];
+    b.cosThetaBins = conf.cosThetaBins();
+    return b;
+  }
+
+  //================================================================
+  myStopAcceptanceMapBuilder::myStopAcceptanceMapBuilder(const Parameters& conf)
+    : art::EDAnalyzer{conf}
+    , statesTag_(conf().statesTag())
+    , stopsTag_(conf().stopsTag())
+    , mapName_(conf().mapName())
+    , map_(binning(conf()))
+    , numStates_(0)
+    , numStopped_(0)
+    , numOutside_(0)
+  {}
+
+  //================================================================
+  void myStopAcceptanceMapBuilder::analyze(const art::Event& event) {
+    const auto& states = *event.getValidHandle<StepPointMCCollection>(statesTag_);
+    const auto& stops = *event.getValidHandle<SimParticlePtrCollection>(stopsTag_);
+
+    // Particles of the states, and whether a stop descends from them
+    std::map<art::Ptr<SimParticle>, bool> stopped;
+    for(const StepPointMC& step : states) {
+      stopped[step.simParticle()] = false;
+    }
+
+    for(const auto& stop : stops) {
+      for(art::Ptr<SimParticle> p = stop; p.isNonnull(); p = p->parent()) {
+        const auto it = stopped.find(p);
+        if(it != stopped.end()) {
+          it->second = true;
+          break;
+        }
+      }
+    }
+
+    for(const StepPointMC& step : states) {
+      const int cell = map_.cell(step.simParticle()->pdgId(), step.position(), step.momentum());
+      if(cell < 0) {
+        ++numOutside_;
+        continue;
+      }
+      const bool s = stopped[step.simParticle()];
+      map_.fill(cell, s);
+      ++numStates_;
+      if(s) ++numStopped_;
+    }
+  }
+
+  //================================================================
+  void myStopAcceptanceMapBuilder::endJob() {
+    art::ServiceHandle<art::TFileService> tfs;
+    map_.write(*tfs, mapName_);
+
+    std::ostringstream os;
+    os<<"myStopAcceptanceMapBuilder stats: "<<numStopped_<<" of "<<numStates_
+      <<" states stopped in "<<map_.size()<<" cells, "<<numOutside_<<" states outside the map";
+    mf::LogInfo("Summary")<<os.str();
+  }
+
+  //================================================================
+
+} // namespace mu2e
+
+DEFINE_ART_MODULE(mu2e::myStopAcceptanceMapBuilder)
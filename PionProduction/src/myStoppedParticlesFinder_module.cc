@@ -1,17 +1,38 @@
 // Identify stopped particles in a given input collection
 // and write them to a new SimParticlePtrCollection.
 //
+// Several named selections (particle types and stopping material) can be
+// evaluated in the same pass over the input.  Each selection writes its
+// own SimParticlePtrCollection instance and its own ntuple "nt_<name>".
+// Without a selections list the top level particleTypes/stoppingMaterial/
+// vetoedMaterials define one unnamed selection, written to the default
+// instance and to "nt" as before.
+//
+// With layout "normalized" the rows go instead to a shared "particles"
+// table and one "children" ("children_<name>") table per selection, see
+// SimParticleTables; "both" writes both layouts.
+//
+// With fillStopDensity the accepted stops of each selection are also
+// histogrammed in (x, y, z, t) during the job and written at endJob as
+// stopDensity<name>Dense/Sparse, see StopDensity.
+//
 // Andrei Gaponenko, 2013
 
 
 #include "TTree.h"
 
+#include "tbb/blocked_range.h"
+#include "tbb/parallel_for.h"
+
 #include <string>
 #include <vector>
 #include <algorithm>
 #include <iterator>
 #include <iostream>
 #include <limits>
+#include <map>
+#include <set>
+#include <cstdint>
 
 #include "cetlib_except/exception.h"
 
@@ -20,12 +41,15 @@
 #include "fhiclcpp/types/Atom.h"
 #include "fhiclcpp/types/OptionalAtom.h"
 #include "fhiclcpp/types/Sequence.h"
+#include "fhiclcpp/types/Table.h"
 
 #include "art/Framework/Core/EDProducer.h"
 #include "art/Framework/Principal/Event.h"
 #include "art/Framework/Principal/SubRun.h"
 #include "art/Framework/Principal/Handle.h"
 #include "art/Framework/Services/Registry/ServiceHandle.h"
+#include "canvas/Persistency/Provenance/ProductID.h"
+#include "canvas/Persistency/Provenance/SubRunID.h"
 #include "art_root_io/TFileService.h"
 
 // Mu2e includes.
@@ -34,6 +58,11 @@
 #include "Offline/MCDataProducts/inc/PhysicalVolumeInfoMultiCollection.hh"
 #include "Offline/Mu2eUtilities/inc/PhysicalVolumeMultiHelper.hh"
 
+#include "PionProduction/inc/SimParticleAncestry.hh"
+#include "PionProduction/inc/SimParticleSelector.hh"
+#include "PionProduction/inc/SimParticleTables.hh"
+#include "PionProduction/inc/StopDensity.hh"
+
 #include "TH1D.h"
 
 namespace mu2e {
@@ -120,9 +149,40 @@ namespace mu2e {
         fhicl::Atom<art::InputTag> physVolInfoInput{ Name("physVolInfoInput"), Comment("The PhysicalVolumeInfoMultiCollection input.") };
         fhicl::Atom<bool> useEventLevelVolumeInfo{ Name("useEventLevelVolumeInfo"), Comment("Get PhysicalVolumeInfoMultiCollection from Event instead of SubRun"), false};
 
+        struct Selection {
+          fhicl::Atom<std::string> name{ Name("name"),
+            Comment("Instance name of the output SimParticlePtrCollection, the ntuple is nt_<name>.")
+          };
+
+          fhicl::Sequence<int> particleTypes{ Name("particleTypes"),
+            Comment("A list of PDG IDs of particles to include in this selection.")
+          };
+
+          fhicl::Atom<std::string> stoppingMaterial{ Name("stoppingMaterial"),
+            Comment("As the top level stoppingMaterial, for this selection."), ""
+          };
+
+          fhicl::Sequence<std::string> vetoedMaterials{ Name("vetoedMaterials"),
+            Comment("As the top level vetoedMaterials, for this selection."), std::vector<std::string>{}
+          };
+        };
+
+        struct DensityGrid {
+          fhicl::Sequence<double,4> low{ Name("low"), Comment("Lower (x, y, z, t) edges, mm and ns") };
+          fhicl::Sequence<double,4> high{ Name("high"), Comment("Upper (x, y, z, t) edges, mm and ns") };
+          fhicl::Sequence<unsigned,4> bins{ Name("bins"), Comment("Number of (x, y, z, t) bins") };
+        };
+
+        struct StopDensityConfig {
+          fhicl::Table<DensityGrid> dense{ Name("dense"), Comment("Fine grid around the stopping target, stored densely") };
+          fhicl::Table<DensityGrid> sparse{ Name("sparse"), Comment("Coarse grid for the other stops, stored sparsely") };
+        };
+
         fhicl::Sequence<int> particleTypes{
           Name("particleTypes"),
-            Comment("A list of PDG IDs of particles to include in the stopped particle search.")
+            Comment("A list of PDG IDs of particles to include in the stopped particle search.\n"
+                "Must be empty if the selections list is used."),
+            std::vector<int>{}
         };
 
         fhicl::Atom<std::string> stoppingMaterial{
@@ -134,7 +194,8 @@ namespace mu2e {
         fhicl::Sequence<std::string> vetoedMaterials{ Name("vetoedMaterials"),
           Comment("Used only if stoppingMaterial is set to an emtpy string.\n"
               "Particles stopping in materials that DO NOT match any on this list will be selected."),
-          [this](){ return stoppingMaterial().empty(); }
+          [this](){ return stoppingMaterial().empty(); },
+          std::vector<std::string>{}
         };
 
         fhicl::OptionalAtom<unsigned> simStageThreshold{ Name("simStageThreshold"),
@@ -144,11 +205,55 @@ namespace mu2e {
               )
         };
 
+        fhicl::Sequence<fhicl::Table<Selection> > selections{ Name("selections"),
+          Comment("Named selections evaluated in one pass, replacing the top level\n"
+              "particleTypes, stoppingMaterial and vetoedMaterials."),
+          std::vector<Selection>{}
+        };
+
         fhicl::Atom<int> verbosityLevel{ Name("verbosityLevel"),
           Comment("Controls the printouts.  Levels 0 through 3 are used.\nHigher levels are more verbose."),
           0
         };
 
+        fhicl::Atom<std::string> layout{ Name("layout"),
+          Comment("Ntuple layout: \"flat\" MuonStop rows with the parent fields, \"normalized\"\n"
+              "particles and children tables, or \"both\".  See SimParticleTables."),
+          "flat"
+        };
+
+        fhicl::Atom<bool> fillStopDensity{ Name("fillStopDensity"),
+          Comment("Histogram the accepted stops in (x, y, z, t), see stopDensity"),
+          false
+        };
+
+        fhicl::Table<StopDensityConfig> stopDensity{ Name("stopDensity"),
+          Comment("Binning of the stop density, used with fillStopDensity"),
+          [this](){ return fillStopDensity(); }
+        };
+
+        fhicl::Atom<bool> exportAncestry{ Name("exportAncestry"),
+          Comment("Write the full ancestry of every ntuple row to the \"ancestry\" tree,\n"
+              "see SimParticleAncestry.  Adds an AncestryIndex column to the ntuples."),
+          false
+        };
+
+        fhicl::Atom<unsigned> parallelThreshold{ Name("parallelThreshold"),
+          Comment("Collections with at least this many particles are scanned in parallel chunks.\n"
+              "0 disables the parallel scan.  The output does not depend on this setting."),
+          50000
+        };
+
+        fhicl::Atom<unsigned> parallelGrainSize{ Name("parallelGrainSize"),
+          Comment("Number of particles per chunk of the parallel scan."),
+          10000
+        };
+
+        fhicl::Table<SimParticleSelector::Config> selection{ Name("selection"),
+          Comment("Additional cuts on the candidate particles, see SimParticleSelector.\n"
+              "Applied after the particle type and stop requirements.")
+        };
+
       };
 
       using Parameters = art::EDProducer::Table<Config>;
@@ -162,30 +267,92 @@ namespace mu2e {
       art::InputTag particleInput_;
       art::InputTag physVolInfoInput_;
       bool useEventLevelVolumeInfo_;
-      std::string stoppingMaterial_;
-      std::vector<std::string> vetoedMaterials_;
 
       bool simStageThresholdConfigured_;
       unsigned simStageThreshold_; // to select particles from the current simulation stage
 
       int verbosityLevel_;
 
-      typedef std::set<PDGCode::type> PDGCodeSet;
-      PDGCodeSet particleTypes_;
+      unsigned parallelThreshold_;
+      unsigned parallelGrainSize_;
+
+      bool writeFlat_;
+      bool writeNormalized_;
+      SimParticleTables::Writer tables_;
+
+      // One per selection if fillStopDensity is set
+      std::vector<StopDensity> stopDensities_;
+
+      bool exportAncestry_;
+      SimParticleAncestry ancestry_;
+      int ancestryIndex_;
+
+      struct Selection {
+        std::string name;
+        std::vector<int> particleTypes;
+        std::string stoppingMaterial;
+        std::vector<std::string> vetoedMaterials;
+
+        // particleTypes and the stop requirement, compiled once
+        SimParticleSelector stopSelector;
+        std::vector<std::vector<bool> > volumeAccepted; // [simStage][endVolumeIndex]
+
+        TTree* nt = nullptr;
+        TTree* children = nullptr;
+        unsigned numRequestedTypeStops = 0;
+        unsigned numRequestedMateralStops = 0;
+      };
+
+      // Bit i of a candidate mask is selection i
+      static constexpr unsigned maxSelections_ = 64;
+      std::vector<Selection> selections_;
+
+      // user cuts from the selection table, common to all selections
+      SimParticleSelector selector_;
 
       TH1* hStopMaterials_;
 
       const PhysicalVolumeInfoMultiCollection *vols_ = nullptr;
 
-      bool isStopped(const SimParticle& particle) const;
-      bool materialAccepted(const std::string& material) const;
+      // Lookup tables indexed by [simStage][endVolumeIndex], rebuilt only
+      // when the PhysicalVolumeInfoMultiCollection contents change, found
+      // with SimParticleSelector::volumesSignature.  The collection is only
+      // hashed when its product ID, subrun or per stage sizes differ from
+      // the last ones, so an event level collection is hashed about once
+      // per subrun rather than every event.
+      bool haveVols_ = false;
+      std::uint64_t volsSignature_ = 0;
+      art::ProductID volsProductID_;
+      art::SubRunID volsSubRun_;
+      std::vector<std::size_t> volsSizes_;
+      std::vector<std::vector<int> > volumeMaterial_;   // dense material index, -1 if no such volume
+
+      // Stop counts per dense material index; the labeled histogram is filled at endJob.
+      std::map<std::string, unsigned> materialIndex_;
+      std::vector<std::string> materialNames_;
+      std::vector<unsigned long> materialCounts_;
+
+      bool materialAccepted(const Selection& sel, const std::string& material) const;
+      void buildVolumeTables();
+      int endMaterial(const SimParticle& particle) const;
 
       unsigned numTotalParticles_;
       unsigned numStageParticles_;
-      unsigned numRequestedTypeStops_;
-      unsigned numRequestedMateralStops_;
 
-      template<class PRINCIPAL> void initVols(const PRINCIPAL& p);
+      // Per-chunk result of the selection pass
+      struct Candidate {
+        const SimParticle* particle;
+        std::uint64_t selections; // bit mask of the matching selections
+      };
+      struct ChunkResult {
+        unsigned numStage = 0;
+        std::vector<Candidate> candidates;
+      };
+
+      void scanChunk(const SimParticleCollection& particles, std::size_t begin, std::size_t end,
+                     ChunkResult& result) const;
+
+      template<class PRINCIPAL> void initVols(const PRINCIPAL& p, const art::SubRunID& subRun);
   };
 
   //================================================================
@@ -195,46 +362,112 @@ namespace mu2e {
     , particleInput_(conf().particleInput())
     , physVolInfoInput_(conf().physVolInfoInput())
     , useEventLevelVolumeInfo_(conf().useEventLevelVolumeInfo())
-    , stoppingMaterial_(conf().stoppingMaterial())
     , simStageThresholdConfigured_(false)
     , simStageThreshold_(-1u)
     , verbosityLevel_(conf().verbosityLevel())
+    , parallelThreshold_(conf().parallelThreshold())
+    , parallelGrainSize_(std::max(1u, conf().parallelGrainSize()))
+    , writeFlat_(conf().layout() != "normalized")
+    , writeNormalized_(conf().layout() != "flat")
+    , exportAncestry_(conf().exportAncestry())
+    , ancestryIndex_(-1)
+    , selector_(conf().selection())
     , hStopMaterials_(art::ServiceHandle<art::TFileService>()->make<TH1D>("stopmat", "Stopping materials", 1, 0., 1.))
     , vols_()
     , numTotalParticles_()
     , numStageParticles_()
-    , numRequestedTypeStops_()
-    , numRequestedMateralStops_()
     {
-      produces<SimParticlePtrCollection>();
+      if(conf().selections().empty()) {
+        Selection sel;
+        sel.particleTypes = conf().particleTypes();
+        sel.stoppingMaterial = conf().stoppingMaterial();
+        if(sel.stoppingMaterial.empty()) {
+          sel.vetoedMaterials = conf().vetoedMaterials();
+        }
+        if(sel.particleTypes.empty()) {
+          throw cet::exception("BADCONFIG")<<"myStoppedParticlesFinder: particleTypes must be set"
+            " when no selections are given"<<std::endl;
+        }
+        selections_.push_back(sel);
+      }
+      else {
+        if(!conf().particleTypes().empty() || !conf().stoppingMaterial().empty()) {
+          throw cet::exception("BADCONFIG")<<"myStoppedParticlesFinder: top level particleTypes and"
+            " stoppingMaterial can not be combined with the selections list"<<std::endl;
+        }
+        std::set<std::string> names;
+        for(const auto& c : conf().selections()) {
+          Selection sel;
+          sel.name = c.name();
+          sel.particleTypes = c.particleTypes();
+          sel.stoppingMaterial = c.stoppingMaterial();
+          if(sel.stoppingMaterial.empty()) {
+            sel.vetoedMaterials = c.vetoedMaterials();
+          }
+          if(sel.name.empty() || !names.insert(sel.name).second) {
+            throw cet::exception("BADCONFIG")<<"myStoppedParticlesFinder: selection names must be"
+              " non-empty and unique, got \""<<sel.name<<"\""<<std::endl;
+          }
+          if(sel.particleTypes.empty()) {
+            throw cet::exception("BADCONFIG")<<"myStoppedParticlesFinder: empty particleTypes"
+              " in selection "<<sel.name<<std::endl;
+          }
+          selections_.push_back(sel);
+        }
+        if(selections_.size() > maxSelections_) {
+          throw cet::exception("BADCONFIG")<<"myStoppedParticlesFinder: at most "<<maxSelections_
+            <<" selections are supported, got "<<selections_.size()<<std::endl;
+        }
+      }
 
-      if(stoppingMaterial_.empty()) {
-        vetoedMaterials_ = conf().vetoedMaterials();
+      if(conf().layout() != "flat" && conf().layout() != "normalized" && conf().layout() != "both") {
+        throw cet::exception("BADCONFIG")<<"myStoppedParticlesFinder: unknown layout \""<<conf().layout()
+          <<"\", expect flat, normalized or both"<<std::endl;
       }
 
       simStageThresholdConfigured_ = conf().simStageThreshold(simStageThreshold_);
 
-      auto pt(conf().particleTypes());
-      for(const auto& pid : pt) {
-        particleTypes_.insert(PDGCode::type(pid));
+      if(conf().fillStopDensity()) {
+        auto grid = [](const Config::DensityGrid& c) {
+          StopDensity::Grid g;
+          for(unsigned i=0; i<4; ++i) { g.low[i] = c.low()[i]; g.high[i] = c.high()[i]; g.bins[i] = c.bins()[i]; }
+          return g;
+        };
+        for(unsigned i = 0; i < selections_.size(); ++i) {
+          stopDensities_.emplace_back(grid(conf().stopDensity().dense()), grid(conf().stopDensity().sparse()));
+        }
+      }
+
+      for(auto& sel : selections_) {
+        produces<SimParticlePtrCollection>(sel.name);
+
+        SimParticleSelector::Settings stops;
+        stops.pdgIds = sel.particleTypes;
+        stops.requireStopped = true;
+        stops.stoppingCodes = { 13 }; // 13=photon conversion
+        sel.stopSelector = SimParticleSelector(stops);
       }
 
       //----------------
       if(verbosityLevel_ > 0) {
         std::ostringstream os;
-        os<<"Particle types: [ ";
-        std::copy(particleTypes_.begin(), particleTypes_.end(), std::ostream_iterator<int>(os, ", "));
-        os<<" ]"<<std::endl;
-
         if(simStageThresholdConfigured_) {
           os<<"simStageThreshold  = "<<simStageThreshold_<<std::endl;
         }
 
-        os<<"stoppingMaterial = "<<stoppingMaterial_<<std::endl;
+        for(const auto& sel : selections_) {
+          os<<"Selection \""<<sel.name<<"\": particle types: [ ";
+          std::copy(sel.particleTypes.begin(), sel.particleTypes.end(), std::ostream_iterator<int>(os, ", "));
+          os<<" ]"<<std::endl;
 
-        os<<"vetoedMaterials = [ ";
-        std::copy(vetoedMaterials_.begin(), vetoedMaterials_.end(), std::ostream_iterator<std::string>(os, ", "));
-        os<<" ]"<<std::endl;
+          os<<"  stoppingMaterial = "<<sel.stoppingMaterial<<std::endl;
+
+          os<<"  vetoedMaterials = [ ";
+          std::copy(sel.vetoedMaterials.begin(), sel.vetoedMaterials.end(), std::ostream_iterator<std::string>(os, ", "));
+          os<<" ]"<<std::endl;
+        }
+
+        os<<"selection = "<<selector_.describe()<<std::endl;
 
         mf::LogInfo("Info")<<os.str();
       }
@@ -242,10 +475,31 @@ namespace mu2e {
 
   //================================================================
   template<class PRINCIPAL>
-    void myStoppedParticlesFinder::initVols(const PRINCIPAL& p) {
+    void myStoppedParticlesFinder::initVols(const PRINCIPAL& p, const art::SubRunID& subRun) {
       const auto& ih = p.template getValidHandle<PhysicalVolumeInfoMultiCollection>(physVolInfoInput_);
       vols_ = &*ih;
 
+      bool sameSizes = (vols_->size() == volsSizes_.size());
+      for(std::size_t i = 0; sameSizes && i < vols_->size(); ++i) {
+        sameSizes = ((*vols_)[i].size() == volsSizes_[i]);
+      }
+      if(haveVols_ && sameSizes && ih.id() == volsProductID_ && subRun == volsSubRun_) {
+        return;
+      }
+      volsProductID_ = ih.id();
+      volsSubRun_ = subRun;
+      volsSizes_.resize(vols_->size());
+      for(std::size_t i = 0; i < vols_->size(); ++i) {
+        volsSizes_[i] = (*vols_)[i].size();
+      }
+
+      const std::uint64_t signature = SimParticleSelector::volumesSignature(*vols_);
+      if(haveVols_ && signature == volsSignature_) {
+        return;
+      }
+      haveVols_ = true;
+      volsSignature_ = signature;
+
       if(verbosityLevel_ > 1) {
         std::cout<<"myStoppedParticlesFinder: PhysicalVolumeInfoMultiCollection dump begin"<<std::endl;
         for(const auto& i : *vols_) {
@@ -265,23 +519,107 @@ namespace mu2e {
         }
         simStageThreshold_ = vols_->size() - 1;  // the current simStage points to the last entry in vols_
       }
+
+      buildVolumeTables();
+      selector_.updateVolumes(*vols_, signature);
+    }
+
+  //================================================================
+  void myStoppedParticlesFinder::buildVolumeTables() {
+    volumeMaterial_.assign(vols_->size(), std::vector<int>());
+    for(auto& sel : selections_) {
+      sel.volumeAccepted.assign(vols_->size(), std::vector<bool>());
+    }
+
+    for(unsigned stage = 0; stage < vols_->size(); ++stage) {
+      const auto& stageVols = (*vols_)[stage];
+
+      unsigned maxIndex = 0;
+      for(const auto& entry : stageVols) {
+        maxIndex = std::max(maxIndex, unsigned(entry.first.asUint()));
+      }
+      volumeMaterial_[stage].assign(stageVols.empty() ? 0 : maxIndex + 1, -1);
+      for(auto& sel : selections_) {
+        sel.volumeAccepted[stage].assign(stageVols.empty() ? 0 : maxIndex + 1, false);
+      }
+
+      for(const auto& entry : stageVols) {
+        const std::string& material = entry.second.materialName();
+        auto im = materialIndex_.find(material);
+        if(im == materialIndex_.end()) {
+          im = materialIndex_.emplace(material, materialNames_.size()).first;
+          materialNames_.push_back(material);
+          materialCounts_.push_back(0);
+        }
+        volumeMaterial_[stage][entry.first.asUint()] = im->second;
+        for(auto& sel : selections_) {
+          sel.volumeAccepted[stage][entry.first.asUint()] = materialAccepted(sel, material);
+        }
+      }
+    }
+
+    if(verbosityLevel_ > 0) {
+      mf::LogInfo("Info")<<"myStoppedParticlesFinder: volume tables built for "<<vols_->size()
+                         <<" stages, "<<materialNames_.size()<<" materials";
+    }
+  }
+
+  //================================================================
+  int myStoppedParticlesFinder::endMaterial(const SimParticle& particle) const {
+    const unsigned stage = particle.simStage();
+    const unsigned index = particle.endVolumeIndex();
+    if(stage >= volumeMaterial_.size() || index >= volumeMaterial_[stage].size()
+       || volumeMaterial_[stage][index] < 0) {
+      throw cet::exception("BADINPUT")<<"myStoppedParticlesFinder: no volume info for simStage "<<stage
+                                      <<", volume index "<<index<<" in "<<physVolInfoInput_<<std::endl;
     }
+    return volumeMaterial_[stage][index];
+  }
 
   //================================================================
 
   void myStoppedParticlesFinder::beginJob() {
 
     art::ServiceHandle<art::TFileService> tfs;
-    static const char branchDesc[] = "RunID/I:SubRunID/I:EventID/L:MuonPID/I:MuonStartT/F:MuonEndT/F:MuonStartX/F:MuonStartY/F:MuonStartZ/F:MuonEndX/F:MuonEndY/F:MuonEndZ/F:MuonStartPx/F:MuonStartPy/F:MuonStartPz/F:ParentPID/I:ParentStartT/F:ParentEndT/F:ParentStartX/F:ParentStartY/F:ParentStartZ/F:ParentEndX/F:ParentEndY/F:ParentEndZ/F:ParentStartPx/F:ParentStartPy/F:ParentStartPz/F:ParentEndPx/F:ParentEndPy/F:ParentEndPz/F";
-    nt_ = tfs->make<TTree>( "nt", "MuonStop ntuple");
-    nt_->Branch("hits", &hit_, branchDesc);
+    const std::string branchDesc = SimParticleTables::FlatRow::flatLeaves("Muon");
+    if(writeNormalized_) {
+      tables_.book(tfs->make<TTree>("particles", "Stopped particles and their parents"));
+    }
+
+    for(auto& sel : selections_) {
+      const std::string suffix = sel.name.empty() ? "" : "_" + sel.name;
+      const std::string title = sel.name.empty() ? "" : ", selection " + sel.name;
+
+      if(writeFlat_) {
+        sel.nt = tfs->make<TTree>(("nt" + suffix).c_str(), ("MuonStop ntuple" + title).c_str());
+        sel.nt->Branch("hits", &hit_, branchDesc.c_str());
+        if(exportAncestry_) {
+          sel.nt->Branch("AncestryIndex", &ancestryIndex_, "AncestryIndex/I");
+        }
+        if(sel.name.empty()) {
+          nt_ = sel.nt;
+        }
+      }
+
+      if(writeNormalized_) {
+        sel.children = tfs->make<TTree>(("children" + suffix).c_str(), ("Stopped particle to parent keys" + title).c_str());
+        tables_.bookChildren(sel.children);
+        if(exportAncestry_) {
+          sel.children->Branch("AncestryIndex", &ancestryIndex_, "AncestryIndex/I");
+        }
+      }
+    }
+
+    if(exportAncestry_) {
+      ancestry_.book(tfs->make<TTree>("ancestry", "SimParticle ancestry of the ntuple rows"));
+    }
 
   }
 
   //================================================================
   void myStoppedParticlesFinder::beginSubRun(art::SubRun& sr) {
     if(!useEventLevelVolumeInfo_) {
-      initVols(sr);
+      initVols(sr, sr.id());
     }
   }
 
@@ -290,101 +628,155 @@ namespace mu2e {
 
       
    if(useEventLevelVolumeInfo_) {
-      initVols(event);
+      initVols(event, event.id().subRunID());
     }
 
-    std::unique_ptr<SimParticlePtrCollection> output(new SimParticlePtrCollection());
+    std::vector<std::unique_ptr<SimParticlePtrCollection> > outputs;
+    for(unsigned i = 0; i < selections_.size(); ++i) {
+      outputs.emplace_back(new SimParticlePtrCollection());
+    }
 
     PhysicalVolumeMultiHelper vi(vols_);
     auto ih = event.getValidHandle<SimParticleCollection>(particleInput_);
     numTotalParticles_ += ih->size();
+    ancestry_.clear();
+    tables_.beginEvent(event.run(), event.subRun(), event.event());
    
-    art::Ptr<SimParticle> Parent;
-
-    for(const auto& i : *ih) {
-      const SimParticle& particle = i.second;
-      if(verbosityLevel_ > 3) {
-          std::cout <<  "STAGE " << particle.simStage() << " vs " << simStageThreshold_ << " pid=" <<particle.pdgId() <<
-          " stopcode=" << particle.stoppingCode().id() << " name=" <<  particle.stoppingCode().name() << std::endl;
-      }
-      if(particle.simStage() >= simStageThreshold_) {
-        ++numStageParticles_;
-
-        if((particleTypes_.find(particle.pdgId()) != particleTypes_.end())
-           && ( isStopped(particle) || particle.stoppingCode().id()==13 ) ) //13=photon conversion
-        {
-          ++numRequestedTypeStops_;
-
-          if(verbosityLevel_ > 2) {
-            std::cout<<"stopped particle "<<particle.pdgId()
-              <<" at pos="<<particle.endPosition()
-              <<" time="<<particle.endGlobalTime()
-              <<" reason="<<particle.stoppingCode()
-              <<" in volume "<<vi.endVolume(particle)
-              <<std::endl;
-          }
-
-          const std::string material = vi.endVolume(particle).materialName();
-          hStopMaterials_->Fill(material.c_str(), 1.);
+    // Selection pass.  Large collections are cut into fixed chunks of
+    // consecutive entries that are scanned concurrently; each chunk writes
+    // only its own result, so concatenating the results in chunk order
+    // reproduces the serial order independently of the scheduling.
+    // The per-particle printout at verbosity > 3 forces a serial scan.
+    const auto& particles = *ih;
+    const std::size_t grain = parallelGrainSize_;
+    const bool parallel = (parallelThreshold_ > 0) && (particles.size() >= parallelThreshold_)
+      && (verbosityLevel_ <= 3);
+    std::vector<ChunkResult> chunks(parallel ? (particles.size() + grain - 1)/grain : 1);
+
+    if(parallel) {
+      tbb::parallel_for(tbb::blocked_range<std::size_t>(0, chunks.size()),
+                        [&](const tbb::blocked_range<std::size_t>& r) {
+                          for(std::size_t c = r.begin(); c != r.end(); ++c) {
+                            scanChunk(particles, c*grain, std::min(particles.size(), (c+1)*grain), chunks[c]);
+                          }
+                        });
+    }
+    else {
+      scanChunk(particles, 0, particles.size(), chunks[0]);
+    }
 
-          if(materialAccepted(material)) {
-            ++numRequestedMateralStops_;
-            output->emplace_back(ih, particle.id().asUint());
+    // Ordered merge: counters, material bookkeeping, output and ntuple rows
+    for(const auto& chunk : chunks) {
+      numStageParticles_ += chunk.numStage;
 
-           if(particle.hasParent()) 
-	  {	   
-	   Parent= particle.parent();
-	   
-	   //std::cout<<"Parent : "<<Parent->pdgId()<<", ("<<
-           //Parent->startPosition().x()<<", "<<Parent->startPosition().y()<<", "<<Parent->startPosition().z()<<") " << Parent->startGlobalTime() <<
-	   //std::endl; 
+      for(const auto& candidate : chunk.candidates) {
+        const SimParticle& particle = *candidate.particle;
 
-           hit_ = MuonStop(event.run(), event.subRun(), event.event(), particle);
+        if(verbosityLevel_ > 2) {
+          std::cout<<"stopped particle "<<particle.pdgId()
+            <<" at pos="<<particle.endPosition()
+            <<" time="<<particle.endGlobalTime()
+            <<" reason="<<particle.stoppingCode()
+            <<" in volume "<<vi.endVolume(particle)
+            <<std::endl;
+        }
 
-           //std::cout<<"Parent : "<<hit_.ParentPID<<", ("<<
-           //hit_.ParentStartX<<", "<<hit_.ParentStartY<<", "<<hit_.ParentStartZ<<") " << hit_.ParentStartT<<
-           //std::endl;
+        ++materialCounts_[endMaterial(particle)];
 
-	   nt_->Fill();
+        // The ntuple row is the same for all selections, build it at most once
+        bool rowFilled = false;
+        for(unsigned isel = 0; isel < selections_.size(); ++isel) {
+          if(!(candidate.selections & (std::uint64_t(1) << isel))) {
+            continue;
+          }
+          Selection& sel = selections_[isel];
+          ++sel.numRequestedTypeStops;
+
+          if(sel.volumeAccepted[particle.simStage()][particle.endVolumeIndex()]) {
+            ++sel.numRequestedMateralStops;
+            outputs[isel]->emplace_back(ih, particle.id().asUint());
+
+            if(!stopDensities_.empty()) {
+              stopDensities_[isel].fill(particle.endPosition().x(), particle.endPosition().y(),
+                                        particle.endPosition().z(), particle.endGlobalTime());
+            }
+
+            if(particle.hasParent()) {
+              if(!rowFilled) {
+                if(writeFlat_) {
+                  hit_ = MuonStop(event.run(), event.subRun(), event.event(), particle);
+                }
+                if(exportAncestry_) {
+                  ancestryIndex_ = ancestry_.addChain(ih.id(), *ih, particle);
+                }
+                rowFilled = true;
+              }
+              if(writeFlat_) {
+                sel.nt->Fill();
+              }
+              if(writeNormalized_) {
+                tables_.add(particle, sel.children);
+              }
+            }
+            else std::cout<<"Error, Muon no Parents"<<std::endl;
           }
-           else std::cout<<"Error, Muon no Parents"<<std::endl;
-
-	  }
         }
       }
+    }
 
+    if(exportAncestry_) {
+      ancestry_.fill(event.run(), event.subRun(), event.event());
     }
 
-    event.put(std::move(output));
+    for(unsigned i = 0; i < selections_.size(); ++i) {
+      event.put(std::move(outputs[i]), selections_[i].name);
+    }
 
 }
 
   //================================================================
-  bool myStoppedParticlesFinder::isStopped(const SimParticle& particle) const {
-    return particle.endMomentum().v().mag2() <= std::numeric_limits<double>::epsilon();
+  void myStoppedParticlesFinder::scanChunk(const SimParticleCollection& particles,
+                                           std::size_t begin, std::size_t end,
+                                           ChunkResult& result) const {
+    // Only reads the particles and the compiled selectors, safe to run concurrently
+    for(auto i = particles.begin() + begin; i != particles.begin() + end; ++i) {
+      const SimParticle& particle = i->second;
+      if(verbosityLevel_ > 3) {
+          std::cout <<  "STAGE " << particle.simStage() << " vs " << simStageThreshold_ << " pid=" <<particle.pdgId() <<
+          " stopcode=" << particle.stoppingCode().id() << " name=" <<  particle.stoppingCode().name() << std::endl;
+      }
+      if(particle.simStage() >= simStageThreshold_) {
+        ++result.numStage;
+        std::uint64_t mask = 0;
+        for(unsigned isel = 0; isel < selections_.size(); ++isel) {
+          if(selections_[isel].stopSelector.accept(particle)) {
+            mask |= std::uint64_t(1) << isel;
+          }
+        }
+        if(mask && selector_.accept(particle)) {
+          result.candidates.push_back(Candidate{&particle, mask});
+        }
+      }
+    }
   }
 
   //================================================================
-  bool myStoppedParticlesFinder::materialAccepted(const std::string& material) const {
-    // Check if the stop is in a material of interest.  The string
-    // comparison looks inefficient, however this is called only for
-    // stopped particles that are a small fraction of all particles.
-    // One could pre-compute a lookup table for stopping volume index,
-    // (rather than the material name string) but that would require
-    // going through all of the O(10^4) volumes at the initialization
-    // stage.
+  bool myStoppedParticlesFinder::materialAccepted(const Selection& sel, const std::string& material) const {
+    // Check if the stop is in a material of interest.  Called once per
+    // volume when the lookup tables are built, the per-stop decision is
+    // then a table lookup on the stopping volume index.
 
     bool ret = false;
-    if(stoppingMaterial_.empty()) {
+    if(sel.stoppingMaterial.empty()) {
       ret = true;
-      for(const auto& i : vetoedMaterials_) {
+      for(const auto& i : sel.vetoedMaterials) {
         if(i == material) {
           ret = false;
         }
       }
     }
     else {
-      ret = (material == stoppingMaterial_);
+      ret = (material == sel.stoppingMaterial);
     }
 
     return ret;
@@ -392,13 +784,38 @@ namespace mu2e {
 
   //================================================================
   void myStoppedParticlesFinder::endJob() {
-    mf::LogInfo("Summary")
-      <<"myStoppedParticlesFinder stats:"
-      <<" accepted = "<<numRequestedMateralStops_
-      <<", requested type stops = "<<numRequestedTypeStops_
-      <<", passing stage cut = "<<numStageParticles_
+    for(unsigned i = 0; i < materialNames_.size(); ++i) {
+      if(materialCounts_[i] > 0) {
+        hStopMaterials_->Fill(materialNames_[i].c_str(), double(materialCounts_[i]));
+      }
+    }
+
+    if(!stopDensities_.empty()) {
+      art::ServiceHandle<art::TFileService> tfs;
+      for(unsigned i = 0; i < selections_.size(); ++i) {
+        const StopDensity& d = stopDensities_[i];
+        d.write(*tfs, "stopDensity" + selections_[i].name,
+                "Stops" + (selections_[i].name.empty() ? std::string() : " " + selections_[i].name));
+        mf::LogInfo("Summary")<<"myStoppedParticlesFinder stop density "<<selections_[i].name
+                              <<": dense grid "<<d.denseStops()<<", sparse grid "<<d.sparseStops()
+                              <<" in "<<d.sparseVoxels()<<" voxels, outside "<<d.outsideStops();
+      }
+    }
+
+    std::ostringstream os;
+    os<<"myStoppedParticlesFinder stats:";
+    for(const auto& sel : selections_) {
+      if(!sel.name.empty()) {
+        os<<"\n  "<<sel.name<<":";
+      }
+      os<<" accepted = "<<sel.numRequestedMateralStops
+        <<", requested type stops = "<<sel.numRequestedTypeStops;
+    }
+    os<<(selections_.size() > 1 ? "\n " : ",")
+      <<" passing stage cut = "<<numStageParticles_
       <<", total input particles = "<<numTotalParticles_
       << "\n";
+    mf::LogInfo("Summary")<<os.str();
   }
 
   //================================================================
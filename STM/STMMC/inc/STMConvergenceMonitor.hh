@@ -0,0 +1,84 @@
+#ifndef STM_STMMC_STMConvergenceMonitor_hh
+#define STM_STMMC_STMConvergenceMonitor_hh
+//
+// Tracks the photopeak efficiency of the STM detectors while a job runs,
+// so that signal jobs can stop generating events once the requested
+// statistical precision is reached.
+//
+// Each reporting analyzer registers a channel (one per detector) with the
+// number of scan configurations it sees, and records for every event
+// whether the deposit fell in the photopeak.  A configuration is
+// converged when all channels reached the target relative error on the
+// efficiency, or the per-configuration event cap.
+//
+
+#include <string>
+#include <vector>
+
+#include "art/Framework/Services/Registry/ServiceDeclarationMacros.h"
+#include "art/Framework/Services/Registry/ServiceTable.h"
+#include "fhiclcpp/types/Atom.h"
+
+namespace mu2e {
+
+  class STMConvergenceMonitor {
+  public:
+    struct Config {
+      using Name=fhicl::Name;
+      using Comment=fhicl::Comment;
+      fhicl::Atom<double> targetRelativeError{Name("targetRelativeError"),
+          Comment("Relative statistical error on the photopeak efficiency at which a configuration is converged")};
+      fhicl::Atom<unsigned long> minEventsPerConfiguration{Name("minEventsPerConfiguration"),
+          Comment("Do not declare convergence before this many events"), 1000};
+      fhicl::Atom<unsigned long> maxEventsPerConfiguration{Name("maxEventsPerConfiguration"),
+          Comment("Declare convergence after this many events regardless of precision, 0 for no limit"), 0};
+      fhicl::Atom<int> verbosityLevel{Name("verbosityLevel"), Comment("Verbosity of output"), 0};
+    };
+    using Parameters = art::ServiceTable<Config>;
+
+    explicit STMConvergenceMonitor(const Parameters& conf);
+
+    // Returns the channel index to be used with record()
+    unsigned registerChannel(const std::string& name, unsigned nConfigurations);
+
+    void record(unsigned channel, unsigned configuration, bool inPeak);
+
+    // Relative error of the photopeak efficiency, infinite without peak counts
+    double relativeError(unsigned channel, unsigned configuration) const;
+
+    // Converged in every channel that sees this configuration
+    bool converged(unsigned configuration) const;
+    bool allConverged() const;
+
+    // Unconverged configuration with the fewest events, for scan jobs that
+    // reallocate events.  Returns nConfigurations if all are converged.
+    unsigned nextConfiguration(unsigned nConfigurations) const;
+
+    void printSummary() const;
+
+  private:
+    struct Counts {
+      unsigned long events = 0;
+      unsigned long peak = 0;
+    };
+    struct Channel {
+      std::string name;
+      std::vector<Counts> counts;
+    };
+
+    double targetRelativeError_;
+    unsigned long minEvents_;
+    unsigned long maxEvents_;
+    int verbosityLevel_;
+
+    std::vector<Channel> channels_;
+    mutable bool reportedConvergence_ = false;
+
+    bool converged(const Counts& c) const;
+  };
+
+} // namespace mu2e
+
+DECLARE_ART_SERVICE(mu2e::STMConvergenceMonitor, LEGACY)
+
+#endif/*STM_STMMC_STMConvergenceMonitor_hh*/
@@ -0,0 +1,74 @@
+// Rejects events once STMConvergenceMonitor reports that every
+// configuration reached its target precision.  Placed at the head of the
+// trigger path it skips generation and Geant4 for the remaining events;
+// end path modules must select on that path (SelectEvents), as they
+// would otherwise run without the generated products.  The source keeps
+// delivering events up to maxEvents, as art does not let a filter end
+// the job, so the remaining events are only skipped.
+
+// stdlib includes
+#include <iostream>
+#include <string>
+
+// art includes
+#include "art/Framework/Core/EDFilter.h"
+#include "art/Framework/Principal/Event.h"
+#include "art/Framework/Services/Registry/ServiceHandle.h"
+
+// fhicl includes
+#include "fhiclcpp/types/Atom.h"
+
+#include "messagefacility/MessageLogger/MessageLogger.h"
+
+#include "STM/STMMC/inc/STMConvergenceMonitor.hh"
+
+namespace mu2e{
+  class STMConvergenceGate : public art::EDFilter
+  {
+  public:
+    using Name=fhicl::Name;
+    using Comment=fhicl::Comment;
+
+    struct Config
+    {
+      fhicl::Atom<bool> verbose{Name("verbose"), Comment("Verbosity of output"), false};
+    };
+
+    using Parameters=art::EDFilter::Table<Config>;
+
+    explicit STMConvergenceGate(const Parameters& pset);
+    virtual bool filter(art::Event& event) override;
+    virtual void endJob() override;
+
+  private:
+    bool _verbose;
+    unsigned long _passed = 0;
+    unsigned long _skipped = 0;
+  };
+  // ===================================================
+  STMConvergenceGate::STMConvergenceGate(const Parameters& conf) :
+    art::EDFilter{conf},
+    _verbose(conf().verbose())
+    {};
+  // ===================================================
+  bool STMConvergenceGate::filter(art::Event& event)
+  {
+    if(art::ServiceHandle<STMConvergenceMonitor>()->allConverged()) {
+      if(_verbose && _skipped == 0) {
+        std::cout<<"STMConvergenceGate: converged, skipping events from "<<event.id()<<std::endl;
+      }
+      ++_skipped;
+      return false;
+    }
+    ++_passed;
+    return true;
+  };
+  // ===================================================
+  void STMConvergenceGate::endJob()
+  {
+    mf::LogInfo("Summary")<<"STMConvergenceGate: passed "<<_passed<<" events, skipped "<<_skipped<<" after convergence";
+  };
+  // ===================================================
+}
+
+DEFINE_ART_MODULE(mu2e::STMConvergenceGate)
@@ -0,0 +1,144 @@
+// Photopeak convergence bookkeeping for adaptive STM signal jobs.
+
+#include "STM/STMMC/inc/STMConvergenceMonitor.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+#include "art/Framework/Services/Registry/ServiceDefinitionMacros.h"
+#include "cetlib_except/exception.h"
+#include "messagefacility/MessageLogger/MessageLogger.h"
+
+namespace mu2e {
+
+  //================================================================
+  STMConvergenceMonitor::STMConvergenceMonitor(const Parameters& conf)
+    : targetRelativeError_(conf().targetRelativeError())
+    , minEvents_(conf().minEventsPerConfiguration())
+    , maxEvents_(conf().maxEventsPerConfiguration())
+    , verbosityLevel_(conf().verbosityLevel())
+  {
+    if(targetRelativeError_ <= 0.) {
+      throw cet::exception("BADCONFIG")<<"STMConvergenceMonitor: targetRelativeError must be positive\n";
+    }
+  }
+
+  //================================================================
+  unsigned STMConvergenceMonitor::registerChannel(const std::string& name, unsigned nConfigurations) {
+    Channel ch;
+    ch.name = name;
+    ch.counts.resize(nConfigurations);
+    channels_.push_back(ch);
+    return channels_.size() - 1;
+  }
+
+  //================================================================
+  void STMConvergenceMonitor::record(unsigned channel, unsigned configuration, bool inPeak) {
+    Counts& c = channels_.at(channel).counts.at(configuration);
+    const bool wasConverged = converged(c);
+    ++c.events;
+    if(inPeak) {
+      ++c.peak;
+    }
+    if(verbosityLevel_ > 0 && !wasConverged && converged(c)) {
+      mf::LogInfo("Info")<<"STMConvergenceMonitor: "<<channels_[channel].name
+                         <<" configuration "<<configuration<<" converged after "<<c.events
+                         <<" events, relative error "<<relativeError(channel, configuration);
+    }
+  }
+
+  //================================================================
+  double STMConvergenceMonitor::relativeError(unsigned channel, unsigned configuration) const {
+    const Counts& c = channels_.at(channel).counts.at(configuration);
+    if(c.peak == 0) {
+      return std::numeric_limits<double>::infinity();
+    }
+    // Binomial error on eff = peak/events, relative to eff
+    const double eff = double(c.peak)/c.events;
+    return std::sqrt((1. - eff)/c.peak);
+  }
+
+  //================================================================
+  bool STMConvergenceMonitor::converged(const Counts& c) const {
+    if(maxEvents_ > 0 && c.events >= maxEvents_) {
+      return true;
+    }
+    if(c.events < minEvents_ || c.peak == 0) {
+      return false;
+    }
+    const double eff = double(c.peak)/c.events;
+    return (1. - eff) <= targetRelativeError_*targetRelativeError_*c.peak;
+  }
+
+  //================================================================
+  bool STMConvergenceMonitor::converged(unsigned configuration) const {
+    for(const auto& ch : channels_) {
+      if(configuration < ch.counts.size() && !converged(ch.counts[configuration])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  //================================================================
+  bool STMConvergenceMonitor::allConverged() const {
+    if(channels_.empty()) {
+      return false;
+    }
+    for(const auto& ch : channels_) {
+      for(const auto& c : ch.counts) {
+        if(!converged(c)) {
+          return false;
+        }
+      }
+    }
+    if(!reportedConvergence_) {
+      reportedConvergence_ = true;
+      printSummary();
+    }
+    return true;
+  }
+
+  //================================================================
+  unsigned STMConvergenceMonitor::nextConfiguration(unsigned nConfigurations) const {
+    unsigned best = nConfigurations;
+    unsigned long bestEvents = std::numeric_limits<unsigned long>::max();
+    for(unsigned i=0; i<nConfigurations; ++i) {
+      if(converged(i)) {
+        continue;
+      }
+      unsigned long n = 0;
+      for(const auto& ch : channels_) {
+        if(i < ch.counts.size()) {
+          n = std::max(n, ch.counts[i].events);
+        }
+      }
+      if(n < bestEvents) {
+        bestEvents = n;
+        best = i;
+      }
+    }
+    return best;
+  }
+
+  //================================================================
+  void STMConvergenceMonitor::printSummary() const {
+    std::ostringstream os;
+    os<<"STMConvergenceMonitor: target relative error "<<targetRelativeError_;
+    for(unsigned ich=0; ich<channels_.size(); ++ich) {
+      const Channel& ch = channels_[ich];
+      for(unsigned i=0; i<ch.counts.size(); ++i) {
+        os<<"\n  "<<ch.name<<" ["<<i<<"] events = "<<ch.counts[i].events
+          <<", peak = "<<ch.counts[i].peak
+          <<", relative error = "<<relativeError(ich, i)
+          <<(converged(ch.counts[i]) ? " converged" : "");
+      }
+    }
+    mf::LogInfo("Summary")<<os.str();
+  }
+
+} // namespace mu2e
+
+DEFINE_ART_SERVICE(mu2e::STMConvergenceMonitor)
@@ -6,11 +6,18 @@
 #include "art/Framework/Principal/Event.h"
 #include "art/Framework/Principal/Run.h"
 
+#include "art/Framework/Services/Registry/ServiceHandle.h"
 #include "canvas/Utilities/InputTag.h"
+#include "cetlib_except/exception.h"
 #include "fhiclcpp/ParameterSet.h"
+#include "fhiclcpp/types/Atom.h"
+#include "fhiclcpp/types/Sequence.h"
+#include "fhiclcpp/types/Table.h"
 
 #include "Offline/MCDataProducts/inc/StepPointMC.hh"
 
+#include "STM/STMMC/inc/STMConvergenceMonitor.hh"
+
 #include "TFile.h"
 #include "TH1F.h"
 
@@ -18,6 +25,9 @@
 #include <string>
 #include <map>
 #include <memory>
+#include <vector>
+#include <cmath>
+#include <algorithm>
 
 namespace mu2e {
 
@@ -40,6 +50,43 @@ namespace mu2e {
         fhicl::Name("outputFileName"),
         fhicl::Comment("Output ROOT file name")
       };
+
+      // Same layout as PhotonScanGun configurations, so that one prolog
+      // table can be used for both modules.
+      struct ScanPoint {
+        fhicl::Atom<double> E{fhicl::Name("E"), fhicl::Comment("Photon energy (MeV)")};
+        fhicl::Atom<double> x{fhicl::Name("x"), fhicl::Comment("Production point x (mm)")};
+        fhicl::Atom<double> y{fhicl::Name("y"), fhicl::Comment("Production point y (mm)")};
+        fhicl::Atom<double> z{fhicl::Name("z"), fhicl::Comment("Production point z (mm)")};
+        fhicl::Atom<double> px{fhicl::Name("px"), fhicl::Comment("Unused here"), 0.};
+        fhicl::Atom<double> py{fhicl::Name("py"), fhicl::Comment("Unused here"), 0.};
+      };
+      fhicl::Sequence<fhicl::Table<ScanPoint>> scanConfigurations {
+        fhicl::Name("scanConfigurations"),
+        fhicl::Comment("Configurations of a PhotonScanGun job.  When not empty the spectra are\n"
+                       "also split by configuration, using the index written by the gun."),
+        std::vector<ScanPoint>{}
+      };
+      fhicl::Atom<art::InputTag> scanIndexTag {
+        fhicl::Name("scanIndexTag"),
+        fhicl::Comment("Configuration index written by PhotonScanGun"),
+        "generate"
+      };
+      fhicl::Atom<bool> monitorConvergence {
+        fhicl::Name("monitorConvergence"),
+        fhicl::Comment("Report photopeak counts to the STMConvergenceMonitor service"),
+        false
+      };
+      fhicl::Atom<double> photopeakEnergy {
+        fhicl::Name("photopeakEnergy"),
+        fhicl::Comment("Photopeak energy (MeV) when not running a scan; scans use each configuration E"),
+        0.
+      };
+      fhicl::Atom<double> photopeakHalfWidth {
+        fhicl::Name("photopeakHalfWidth"),
+        fhicl::Comment("Half width (MeV) of the photopeak window on the total deposit"),
+        0.003
+      };
     };
 
     using Parameters = art::EDAnalyzer::Table<Config>;
@@ -64,11 +111,32 @@ namespace mu2e {
     EnergyDeposits _totalEnergySum;
     int _totalEvents = 0;
 
+    struct ScanPoint {
+      double E, x, y, z;
+    };
+    std::vector<ScanPoint> _scanPoints;
+    art::InputTag _scanIndexTag;
+
+    bool _monitorConvergence;
+    double _photopeakEnergy;
+    double _photopeakHalfWidth;
+    unsigned _monitorChannel = 0;
+
     // ROOT
     std::unique_ptr<TFile> _outputFile;
     TH1F* _hTotalEnergy = nullptr;
     TH1F* _hVisibleEnergy = nullptr;
     TH1F* _hNonIonizingEnergy = nullptr;
+
+    struct ScanHistograms {
+      TH1F* total = nullptr;
+      TH1F* visible = nullptr;
+      TH1F* nonIonizing = nullptr;
+    };
+    std::vector<ScanHistograms> _scanHistograms;
+    TH1F* _hScanEvents = nullptr;
+
+    unsigned scanIndex(const art::Event& event) const;
   };
 
   // ------------------------------------------------------------------
@@ -78,8 +146,23 @@ namespace mu2e {
       _stepPointMCTag(conf().stepPointMCTag()),
       _verboseLevel(conf().verboseLevel()),
       _groupByVolume(conf().groupByVolume()),
-      _outputFileName(conf().outputFileName())
+      _outputFileName(conf().outputFileName()),
+      _scanIndexTag(conf().scanIndexTag()),
+      _monitorConvergence(conf().monitorConvergence()),
+      _photopeakEnergy(conf().photopeakEnergy()),
+      _photopeakHalfWidth(conf().photopeakHalfWidth())
   {
+    for (const auto& c : conf().scanConfigurations()) {
+      _scanPoints.push_back(ScanPoint{c.E(), c.x(), c.y(), c.z()});
+    }
+    if (_monitorConvergence) {
+      if (_scanPoints.empty() && _photopeakEnergy <= 0.) {
+        throw cet::exception("BADCONFIG")
+          << "STMDepositEnergy: monitorConvergence needs photopeakEnergy or scanConfigurations\n";
+      }
+      _monitorChannel = art::ServiceHandle<STMConvergenceMonitor>()->registerChannel(
+        _stepPointMCTag.encode(), std::max<std::size_t>(_scanPoints.size(), 1));
+    }
     std::cout << "STMDepositEnergy initialized with tag: "
               << _stepPointMCTag << std::endl;
     std::cout << "Output file: " << _outputFileName << std::endl;
@@ -105,6 +188,40 @@ namespace mu2e {
       new TH1F("hNonIonizingEnergy",
                "Non-Ionizing Energy Deposit;Energy (MeV);Events",
                1000, 0, 20);
+
+    if (!_scanPoints.empty()) {
+      _hScanEvents = new TH1F("hScanEvents",
+                              "Generated events per scan configuration;Configuration;Events",
+                              _scanPoints.size(), 0, _scanPoints.size());
+    }
+    for (unsigned i = 0; i < _scanPoints.size(); ++i) {
+      const std::string suffix = "_" + std::to_string(i);
+      const std::string label = " (E=" + std::to_string(_scanPoints[i].E)
+        + " MeV, x=" + std::to_string(_scanPoints[i].x) + " mm)";
+      ScanHistograms h;
+      h.total = new TH1F(("hTotalEnergy" + suffix).c_str(),
+                         ("Total Energy Deposit" + label + ";Energy (MeV);Events").c_str(),
+                         1000, 0, 100);
+      h.visible = new TH1F(("hVisibleEnergy" + suffix).c_str(),
+                           ("Visible Energy Deposit" + label + ";Energy (MeV);Events").c_str(),
+                           1000, 0, 100);
+      h.nonIonizing = new TH1F(("hNonIonizingEnergy" + suffix).c_str(),
+                               ("Non-Ionizing Energy Deposit" + label + ";Energy (MeV);Events").c_str(),
+                               1000, 0, 20);
+      _scanHistograms.push_back(h);
+    }
+  }
+
+  // ------------------------------------------------------------------
+
+  unsigned STMDepositEnergy::scanIndex(const art::Event& event) const {
+    const unsigned index = *event.getValidHandle<unsigned>(_scanIndexTag);
+    if (index >= _scanPoints.size()) {
+      throw cet::exception("BADCONFIG")
+        << "STMDepositEnergy: event " << event.id() << " has scan configuration " << index
+        << " but only " << _scanPoints.size() << " scanConfigurations are configured\n";
+    }
+    return index;
   }
 
   // ------------------------------------------------------------------
@@ -135,11 +252,33 @@ namespace mu2e {
     _totalEnergySum.nonIonizing += energyDeposits.nonIonizing;
     _totalEvents++;
 
+    // Configuration of this event, counted even without a deposit so
+    // that efficiencies can be formed per configuration.
+    const ScanHistograms* scanh = nullptr;
+    unsigned index = 0;
+    if (!_scanHistograms.empty()) {
+      index = scanIndex(event);
+      _hScanEvents->Fill(index);
+      scanh = &_scanHistograms[index];
+    }
+
+    if (_monitorConvergence) {
+      const double peak = _scanPoints.empty() ? _photopeakEnergy : _scanPoints[index].E;
+      const bool inPeak = std::abs(energyDeposits.total - peak) < _photopeakHalfWidth;
+      art::ServiceHandle<STMConvergenceMonitor>()->record(_monitorChannel, index, inPeak);
+    }
+
     // 仅当 total > 1e-8 时才填充 histogram
     if (energyDeposits.total > 1e-8) {
       _hTotalEnergy->Fill(energyDeposits.total);
       _hVisibleEnergy->Fill(energyDeposits.visible);
       _hNonIonizingEnergy->Fill(energyDeposits.nonIonizing);
+
+      if (scanh) {
+        scanh->total->Fill(energyDeposits.total);
+        scanh->visible->Fill(energyDeposits.visible);
+        scanh->nonIonizing->Fill(energyDeposits.nonIonizing);
+      }
     }
 
     if (_verboseLevel > 0) {
@@ -171,6 +310,14 @@ namespace mu2e {
       _hTotalEnergy->Write();
       _hVisibleEnergy->Write();
       _hNonIonizingEnergy->Write();
+      if (_hScanEvents) {
+        _hScanEvents->Write();
+      }
+      for (const auto& h : _scanHistograms) {
+        h.total->Write();
+        h.visible->Write();
+        h.nonIonizing->Write();
+      }
       _outputFile->Close();
     }
   }
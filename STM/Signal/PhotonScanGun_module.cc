@@ -0,0 +1,150 @@
+// Photon gun that loops over a list of (energy, position) configurations
+// within one job, so that the geometry and Geant4 initialization is paid
+// once for a whole efficiency scan instead of once per configuration.
+//
+// Configurations are assigned round-robin on the event number.  The
+// index of the configuration of an event is put in the event as an
+// unsigned int product next to the GenParticles, and read back by
+// STMDepositEnergy (scanIndexTag).
+//
+// With reallocateEvents the next event instead goes to the unconverged
+// configuration with the fewest events according to STMConvergenceMonitor,
+// so configurations that reached their precision stop consuming CPU.
+
+#include <iostream>
+#include <string>
+#include <cmath>
+#include <memory>
+#include <vector>
+#include <sstream>
+
+#include "cetlib_except/exception.h"
+
+#include "fhiclcpp/types/Atom.h"
+#include "fhiclcpp/types/Sequence.h"
+#include "fhiclcpp/types/Table.h"
+
+#include "CLHEP/Vector/ThreeVector.h"
+#include "CLHEP/Vector/LorentzVector.h"
+
+#include "art/Framework/Core/EDProducer.h"
+#include "art/Framework/Principal/Event.h"
+#include "art/Framework/Principal/Handle.h"
+#include "art/Framework/Services/Registry/ServiceHandle.h"
+
+#include "messagefacility/MessageLogger/MessageLogger.h"
+
+#include "Offline/DataProducts/inc/PDGCode.hh"
+#include "Offline/MCDataProducts/inc/GenParticle.hh"
+
+#include "STM/STMMC/inc/STMConvergenceMonitor.hh"
+
+namespace mu2e {
+
+  //================================================================
+  class PhotonScanGun : public art::EDProducer {
+  public:
+    using Name=fhicl::Name;
+    using Comment=fhicl::Comment;
+
+    struct ScanPoint {
+      fhicl::Atom<double> E{Name("E"), Comment("Photon energy (MeV)")};
+      fhicl::Atom<double> x{Name("x"), Comment("Production point x (mm)")};
+      fhicl::Atom<double> y{Name("y"), Comment("Production point y (mm)")};
+      fhicl::Atom<double> z{Name("z"), Comment("Production point z (mm)")};
+      fhicl::Atom<double> px{Name("px"), Comment("Photon momentum x (MeV), pz is set from E"), 0.};
+      fhicl::Atom<double> py{Name("py"), Comment("Photon momentum y (MeV), pz is set from E"), 0.};
+    };
+
+    struct Config {
+      fhicl::Sequence<fhicl::Table<ScanPoint>> configurations{Name("configurations"),
+          Comment("List of (E, x, y, z) configurations.  Event N uses configuration (N-1) % size.")};
+      fhicl::Atom<bool> reallocateEvents{Name("reallocateEvents"),
+          Comment("Pick configurations from the STMConvergenceMonitor service instead of round-robin"), false};
+      fhicl::Atom<int> verbosityLevel{Name("verbosityLevel"), Comment("Verbosity of output"), 0};
+    };
+
+    using Parameters=art::EDProducer::Table<Config>;
+
+    explicit PhotonScanGun(const Parameters& conf);
+    void produce(art::Event& event) override;
+    void endJob() override;
+
+  private:
+    struct Point {
+      CLHEP::Hep3Vector pos;
+      CLHEP::HepLorentzVector mom;
+    };
+
+    std::vector<Point> _points;
+    std::vector<unsigned long> _nGenerated;
+    bool _reallocateEvents;
+    int _verbosityLevel;
+  };
+
+  //================================================================
+  PhotonScanGun::PhotonScanGun(const Parameters& conf) :
+    art::EDProducer{conf},
+    _reallocateEvents(conf().reallocateEvents()),
+    _verbosityLevel(conf().verbosityLevel())
+  {
+    produces<GenParticleCollection>();
+    produces<unsigned>();
+
+    for (const auto& c : conf().configurations()) {
+      const double e = c.E();
+      const double pt2 = c.px()*c.px() + c.py()*c.py();
+      if (pt2 > e*e) {
+        throw cet::exception("BADCONFIG")
+          << "PhotonScanGun: transverse momentum exceeds E = " << e << " for configuration "
+          << _points.size() << "\n";
+      }
+      Point p;
+      p.pos = CLHEP::Hep3Vector(c.x(), c.y(), c.z());
+      p.mom = CLHEP::HepLorentzVector(c.px(), c.py(), std::sqrt(e*e - pt2), e);
+      _points.push_back(p);
+    }
+
+    if (_points.empty()) {
+      throw cet::exception("BADCONFIG") << "PhotonScanGun: empty configurations list\n";
+    }
+    _nGenerated.resize(_points.size(), 0);
+  }
+
+  //================================================================
+  void PhotonScanGun::produce(art::Event& event) {
+    unsigned index = (event.event() - 1) % _points.size();
+    if (_reallocateEvents) {
+      const unsigned next = art::ServiceHandle<STMConvergenceMonitor>()->nextConfiguration(_points.size());
+      if (next < _points.size()) {
+        index = next;
+      }
+    }
+    const Point& p = _points[index];
+    ++_nGenerated[index];
+
+    std::unique_ptr<GenParticleCollection> output(new GenParticleCollection);
+    output->emplace_back(PDGCode::gamma, GenId::particleGun, p.pos, p.mom, 0.);
+
+    if (_verbosityLevel > 1) {
+      std::cout << "PhotonScanGun: event " << event.id() << " configuration " << index << std::endl;
+    }
+
+    event.put(std::move(output));
+    event.put(std::make_unique<unsigned>(index));
+  }
+
+  //================================================================
+  void PhotonScanGun::endJob() {
+    std::ostringstream os;
+    os << "PhotonScanGun events per configuration:";
+    for (unsigned i = 0; i < _points.size(); ++i) {
+      os << "\n  [" << i << "] E = " << _points[i].mom.e()
+         << " MeV at " << _points[i].pos << " : " << _nGenerated[i];
+    }
+    mf::LogInfo("Summary") << os.str();
+  }
+
+} // namespace mu2e
+
+DEFINE_ART_MODULE(mu2e::PhotonScanGun)
@@ -4,12 +4,20 @@
 // a different base class (EDProducer).
 //
 // Generate muonic-Aluminum X-rays from the muon stop distribution.
+//
+// The stops are taken either from an input SimParticleCollection
+// (inputSimParticles), or, with stopDensityFile, sampled from the
+// (x, y, z, t) stop density histograms written by myStoppedParticlesFinder,
+// in which case the gun needs no input file and runs from EmptyEvent.
 
 #include <iostream>
 #include <string>
 #include <cmath>
 #include <memory>
 #include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
 
 #include "cetlib_except/exception.h"
 
@@ -34,6 +42,7 @@
 #include "Offline/DataProducts/inc/PDGCode.hh"
 #include "Offline/MCDataProducts/inc/GenParticle.hh"
 #include "Offline/MCDataProducts/inc/SimParticle.hh"
+#include "Offline/MCDataProducts/inc/EventWeight.hh"
 #include "Offline/Mu2eUtilities/inc/RandomUnitSphere.hh"
 #include "CLHEP/Random/RandFlat.h"
 #include "Offline/Mu2eUtilities/inc/Table.hh"
@@ -44,13 +53,269 @@
 #include "Offline/StoppingTargetGeom/inc/zBinningForFoils.hh"
 #include "Offline/StoppingTargetGeom/inc/StoppingTarget.hh"
 
+#include "TAxis.h"
+#include "TFile.h"
 #include "TH1F.h"
 #include "TH2F.h"
+#include "THnBase.h"
+#include "THnSparse.h"
 
 using namespace std;
 
 namespace mu2e {
 
+  //================================================================
+  // Counter-based (Philox4x32-10) engine.  The output is a pure function
+  // of the key and the counter, so keying the counter on the event ID
+  // makes every event's random sequence independent of the order in
+  // which events are processed, of the thread count and of sharding.
+  class PhiloxEngine : public CLHEP::HepRandomEngine {
+  public:
+    PhiloxEngine() : _key{{0, 0}}, _ctr{{0, 0, 0, 0}}, _block{{0, 0, 0, 0}}, _used(4) {}
+
+    // Restart the sequence for the given event in the given stream.
+    void setEvent(uint32_t run, uint32_t subrun, uint32_t event, uint32_t stream, uint32_t seed) {
+      _key = {{stream, seed}};
+      _ctr = {{0, event, subrun, run}};
+      _used = 4;
+    }
+
+    double flat() override {
+      // 53 random bits, offset by half an ulp so that 0 and 1 are never returned
+      const uint64_t hi = next32();
+      const uint64_t lo = next32();
+      const uint64_t bits = (hi << 21) ^ (lo >> 11);
+      return (static_cast<double>(bits) + 0.5) * 0x1.0p-53;
+    }
+
+    void flatArray(const int size, double* vect) override {
+      for(int i=0; i<size; ++i) {
+        vect[i] = flat();
+      }
+    }
+
+    operator unsigned int() override { return next32(); }
+
+    void setSeed(long seed, int) override { _key[1] = static_cast<uint32_t>(seed); _used = 4; }
+    void setSeeds(const long* seeds, int) override { if(seeds && *seeds) setSeed(*seeds, 0); }
+    void saveStatus(const char[]) const override {}
+    void restoreStatus(const char[]) override {}
+    void showStatus() const override {
+      std::cout<<"PhiloxEngine key = ("<<_key[0]<<", "<<_key[1]<<"), counter = ("
+               <<_ctr[0]<<", "<<_ctr[1]<<", "<<_ctr[2]<<", "<<_ctr[3]<<")"<<std::endl;
+    }
+    std::string name() const override { return "PhiloxEngine"; }
+
+  private:
+    std::array<uint32_t,2> _key;
+    std::array<uint32_t,4> _ctr;
+    std::array<uint32_t,4> _block;
+    unsigned _used;
+
+    uint32_t next32() {
+      if(_used == 4) {
+        _block = philox(_ctr, _key);
+        ++_ctr[0];
+        _used = 0;
+      }
+      return _block[_used++];
+    }
+
+    static std::array<uint32_t,4> philox(std::array<uint32_t,4> c, std::array<uint32_t,2> k) {
+      for(int round=0; round<10; ++round) {
+        const uint64_t p0 = uint64_t(0xD2511F53u) * c[0];
+        const uint64_t p1 = uint64_t(0xCD9E8D57u) * c[2];
+        c = {{ uint32_t(p1 >> 32) ^ c[1] ^ k[0], uint32_t(p1),
+               uint32_t(p0 >> 32) ^ c[3] ^ k[1], uint32_t(p0) }};
+        k[0] += 0x9E3779B9u;
+        k[1] += 0xBB67AE85u;
+      }
+      return c;
+    }
+  };
+
+  //================================================================
+  // Samples (x, y, z, t) from binned stop densities: a voxel is chosen with
+  // Walker's alias method in constant time, then the point is drawn
+  // uniformly inside the voxel.
+  //
+  // StopDensity counts a stop inside the dense (THn) grid there only, so a
+  // sparse (THnSparse) voxel overlapping a dense grid holds only the stops
+  // outside it.  build() clips such voxels to the part outside the dense
+  // grids and shares their weight by volume among the clipped pieces.
+  class StopDensitySampler {
+  public:
+    // Adds the non-empty, in-range bins of a 4D THn or THnSparse
+    void add(const THnBase& h) {
+      if (h.GetNdimensions() != 4) {
+        throw cet::exception("BADINPUT") << "StopDensitySampler: " << h.GetName()
+                                         << " is not an (x, y, z, t) histogram\n";
+      }
+      const bool sparse = dynamic_cast<const THnSparse*>(&h) != nullptr;
+      if (!sparse) {
+        Box b;
+        for (int d = 0; d < 4; ++d) {
+          b.low[d] = h.GetAxis(d)->GetXmin();
+          b.high[d] = h.GetAxis(d)->GetXmax();
+        }
+        _dense.push_back(b);
+      }
+      std::array<Int_t,4> idx;
+      for (Long64_t i = 0; i < h.GetNbins(); ++i) {
+        const double w = h.GetBinContent(i, idx.data());
+        if (!(w > 0.)) continue;
+        Voxel v;
+        bool inRange = true;
+        for (int d = 0; d < 4; ++d) {
+          const TAxis* a = h.GetAxis(d);
+          inRange = inRange && idx[d] >= 1 && idx[d] <= a->GetNbins();
+          v.low[d] = a->GetBinLowEdge(idx[d]);
+          v.width[d] = a->GetBinWidth(idx[d]);
+        }
+        if (inRange) {
+          _voxels.push_back(v);
+          _weights.push_back(w);
+          _sparse.push_back(sparse);
+        }
+      }
+    }
+
+    // Builds the alias table, call after all add()
+    void build() {
+      clip();
+      const std::size_t n = _weights.size();
+      if (n == 0) {
+        throw cet::exception("BADINPUT") << "StopDensitySampler: no non-empty bins in the stop density\n";
+      }
+      double sum = 0.;
+      for (double w : _weights) sum += w;
+
+      _prob.assign(n, 0.);
+      _alias.assign(n, 0);
+      std::vector<double> scaled(n);
+      std::vector<uint32_t> small, large;
+      for (std::size_t i = 0; i < n; ++i) {
+        scaled[i] = _weights[i]*n/sum;
+        (scaled[i] < 1. ? small : large).push_back(i);
+      }
+      while (!small.empty() && !large.empty()) {
+        const uint32_t s = small.back(); small.pop_back();
+        const uint32_t l = large.back();
+        _prob[s] = scaled[s];
+        _alias[s] = l;
+        scaled[l] -= 1. - scaled[s];
+        if (scaled[l] < 1.) {
+          large.pop_back();
+          small.push_back(l);
+        }
+      }
+      // Leftovers are 1 up to rounding
+      for (uint32_t i : large) _prob[i] = 1.;
+      for (uint32_t i : small) _prob[i] = 1.;
+      _weights.clear();
+      _weights.shrink_to_fit();
+    }
+
+    void fire(CLHEP::RandFlat& flat, CLHEP::Hep3Vector& pos, double& time) const {
+      const double u = flat.fire()*_prob.size();
+      std::size_t i = std::min(std::size_t(u), _prob.size() - 1);
+      if (u - i >= _prob[i]) i = _alias[i];
+      const Voxel& v = _voxels[i];
+      pos.set(v.low[0] + flat.fire()*v.width[0],
+              v.low[1] + flat.fire()*v.width[1],
+              v.low[2] + flat.fire()*v.width[2]);
+      time = v.low[3] + flat.fire()*v.width[3];
+    }
+
+    std::size_t size() const { return _voxels.size(); }
+
+  private:
+    struct Voxel {
+      double low[4];
+      double width[4];
+    };
+    struct Box {
+      double low[4];
+      double high[4];
+    };
+    std::vector<Voxel> _voxels;
+    std::vector<double> _weights;
+    std::vector<bool> _sparse;
+    std::vector<Box> _dense;
+
+    static double volume(const Voxel& v) {
+      return v.width[0]*v.width[1]*v.width[2]*v.width[3];
+    }
+
+    // Appends the parts of v outside b, at most two slabs per axis
+    static void subtract(const Voxel& v, const Box& b, std::vector<Voxel>& out) {
+      double lo[4], hi[4];
+      for (int d = 0; d < 4; ++d) {
+        lo[d] = std::max(v.low[d], b.low[d]);
+        hi[d] = std::min(v.low[d] + v.width[d], b.high[d]);
+        if (!(lo[d] < hi[d])) {
+          out.push_back(v);
+          return;
+        }
+      }
+      Voxel rest = v;
+      for (int d = 0; d < 4; ++d) {
+        const double high = rest.low[d] + rest.width[d];
+        if (rest.low[d] < lo[d]) {
+          Voxel piece = rest;
+          piece.width[d] = lo[d] - rest.low[d];
+          out.push_back(piece);
+        }
+        if (hi[d] < high) {
+          Voxel piece = rest;
+          piece.low[d] = hi[d];
+          piece.width[d] = high - hi[d];
+          out.push_back(piece);
+        }
+        rest.low[d] = lo[d];
+        rest.width[d] = hi[d] - lo[d];
+      }
+      // rest is inside b and dropped
+    }
+
+    // Replaces the sparse voxels overlapping a dense grid by their parts
+    // outside all dense grids
+    void clip() {
+      if (_dense.empty()) return;
+      std::vector<Voxel> voxels;
+      std::vector<double> weights;
+      std::vector<Voxel> pieces, next;
+      for (std::size_t i = 0; i < _voxels.size(); ++i) {
+        if (!_sparse[i]) {
+          voxels.push_back(_voxels[i]);
+          weights.push_back(_weights[i]);
+          continue;
+        }
+        pieces.assign(1, _voxels[i]);
+        for (const Box& b : _dense) {
+          next.clear();
+          for (const Voxel& p : pieces) subtract(p, b, next);
+          pieces.swap(next);
+        }
+        double outside = 0.;
+        for (const Voxel& p : pieces) outside += volume(p);
+        if (!(outside > 0.)) {
+          throw cet::exception("BADINPUT") << "StopDensitySampler: sparse voxel with stops inside the dense grid,"
+                                           << " the stop density histograms do not come from one StopDensity\n";
+        }
+        for (const Voxel& p : pieces) {
+          voxels.push_back(p);
+          weights.push_back(_weights[i]*volume(p)/outside);
+        }
+      }
+      _voxels.swap(voxels);
+      _weights.swap(weights);
+      _sparse.clear();
+    }
+    std::vector<double> _prob;
+    std::vector<uint32_t> _alias;
+  };
+
   //================================================================
   class StoppedMuonXRayGammaRayGun : public art::EDProducer {
     fhicl::ParameterSet _psphys;
@@ -65,10 +330,24 @@ namespace mu2e {
     double _phimax;
 
     art::RandomNumberGenerator::base_engine_t& _eng;
+
+    // With counterBasedRNG all draws come from _philox, re-keyed on
+    // (run, subrun, event, rngStream) at the start of every event.
+    bool _counterBasedRNG;
+    unsigned _rngStream;
+    unsigned _rngSeed;
+    PhiloxEngine _philox;
+    CLHEP::HepRandomEngine& _genEng;
+
     RandomUnitSphere _randomUnitSphere;
     CLHEP::RandFlat _randFlat;
     CLHEP::RandExponential  _randExp;
     
+    // Stop density histograms, sampled instead of reading stopped muons
+    std::string _stopDensityFile;
+    std::vector<std::string> _stopDensityHistograms;
+    StopDensitySampler _stopSampler;
+
     // 替换 RootTreeSampler 为 SimParticleCollection 的输入标签
     art::InputTag _inputSimParticles;
 
@@ -78,6 +357,13 @@ namespace mu2e {
     bool _do844;
     bool _do1809;
 
+    // Truncate the delayed 844 keV emission to the analysis time window.
+    // Photons that would fall outside the window are never generated;
+    // in-window ones carry the in-window probability as an EventWeight.
+    bool _truncate844;
+    double _timeWindowMin;
+    double _timeWindowMax;
+
     // Control histograms.
     bool _doHistograms;
 
@@ -94,8 +380,13 @@ namespace mu2e {
 
     void bookHistograms();
 
+    // Returns the in-window probability, and the sampled delay in dt,
+    // for an exponential delay of the given mean lifetime emitted at t0.
+    double sampleTruncatedDelay(double t0, double meanLifetime, double& dt);
+
   public:
     explicit StoppedMuonXRayGammaRayGun(const fhicl::ParameterSet& pset);
+    virtual void beginJob();
     virtual void produce(art::Event& event);
   };
 
@@ -109,14 +400,25 @@ namespace mu2e {
     _phimin(_psphys.get<double>("phimin", 0. )),
     _phimax(_psphys.get<double>("phimax", CLHEP::twopi )),
     _eng(createEngine(art::ServiceHandle<SeedService>()->getSeed())),
-    _randomUnitSphere(_eng, _czmin, _czmax, _phimin, _phimax ),
-    _randFlat(_eng),
-    _randExp(_eng),
-    _inputSimParticles(pset.get<art::InputTag>("inputSimParticles")),
+    _counterBasedRNG(_psphys.get<bool>("counterBasedRNG", false )),
+    _rngStream(_psphys.get<unsigned>("rngStream", 0 )),
+    _rngSeed(art::ServiceHandle<SeedService>()->getSeed()),
+    _philox(),
+    _genEng(_counterBasedRNG ? static_cast<CLHEP::HepRandomEngine&>(_philox) : _eng),
+    _randomUnitSphere(_genEng, _czmin, _czmax, _phimin, _phimax ),
+    _randFlat(_genEng),
+    _randExp(_genEng),
+    _stopDensityFile(pset.get<std::string>("stopDensityFile", "")),
+    _stopDensityHistograms(pset.get<std::vector<std::string> >("stopDensityHistograms",
+        {"stoppedMuonFinder/stopDensityDense", "stoppedMuonFinder/stopDensitySparse"})),
+    _inputSimParticles(_stopDensityFile.empty() ? pset.get<art::InputTag>("inputSimParticles") : art::InputTag()),
     _do66(_psphys.get<bool>("do66", true )),
     _do347(_psphys.get<bool>("do347", true )),
     _do844(_psphys.get<bool>("do844", true )),
     _do1809(_psphys.get<bool>("do1809", true )),
+    _truncate844(_psphys.get<bool>("truncate844", false )),
+    _timeWindowMin(_truncate844 ? _psphys.get<double>("timeWindowMin") : 0.),
+    _timeWindowMax(_truncate844 ? _psphys.get<double>("timeWindowMax") : 0.),
     _doHistograms(_psphys.get<bool>("doHistograms", true )),
     _hMultiplicity(0),
     _hcz(0),
@@ -129,35 +431,86 @@ namespace mu2e {
 
     produces<mu2e::GenParticleCollection>();
 
+    if ( _truncate844 ) {
+      if ( _timeWindowMax <= _timeWindowMin ) {
+        throw cet::exception("BADCONFIG")
+          << "StoppedMuonXRayGammaRayGun: timeWindowMax must be above timeWindowMin, got ["
+          << _timeWindowMin << ", " << _timeWindowMax << "]\n";
+      }
+      // The weight applies to the whole event, so it is only meaningful
+      // when the 844 keV line is the only one generated.
+      if ( _do66 || _do347 || _do1809 || !_do844 ) {
+        throw cet::exception("BADCONFIG")
+          << "StoppedMuonXRayGammaRayGun: truncate844 requires do844 to be the only enabled line\n";
+      }
+      produces<mu2e::EventWeight>();
+    }
+
     if ( _doHistograms ) bookHistograms();
   }
 
+  //================================================================
+  void StoppedMuonXRayGammaRayGun::beginJob() {
+    if (_stopDensityFile.empty()) return;
+
+    ConfigFileLookupPolicy findConfig;
+    const std::string fileName = findConfig(_stopDensityFile);
+    std::unique_ptr<TFile> f(TFile::Open(fileName.c_str(), "READ"));
+    if (!f || f->IsZombie()) {
+      throw cet::exception("BADCONFIG") << "StoppedMuonXRayGammaRayGun: can not open stopDensityFile "
+                                        << fileName << "\n";
+    }
+    for (const auto& name : _stopDensityHistograms) {
+      const THnBase* h = dynamic_cast<const THnBase*>(f->Get(name.c_str()));
+      if (!h) {
+        throw cet::exception("BADCONFIG") << "StoppedMuonXRayGammaRayGun: no THn or THnSparse "
+                                          << name << " in " << fileName << "\n";
+      }
+      _stopSampler.add(*h);
+    }
+    _stopSampler.build();
+    std::cout << "StoppedMuonXRayGammaRayGun: sampling stops from " << _stopSampler.size()
+              << " voxels of " << fileName << std::endl;
+  }
+
   //================================================================
   void StoppedMuonXRayGammaRayGun::produce(art::Event& event) {
     std::unique_ptr<GenParticleCollection> output(new GenParticleCollection);
 
-    // 获取 SimParticleCollection
-    const auto simh = event.getValidHandle<SimParticleCollection>(_inputSimParticles);
-    
-    // 获取停止μ子列表
-    const auto mus = stoppedMuMinusList(simh);
+    if (_counterBasedRNG) {
+      _philox.setEvent(event.run(), event.subRun(), event.event(), _rngStream, _rngSeed);
+    }
 
-    if(mus.empty()) {
-      throw cet::exception("BADINPUT")
-        << "StoppedMuonXRayGammaRayGun::produce(): no suitable stopped muon in the input SimParticleCollection\n";
+    CLHEP::Hep3Vector pos;
+    double time = 0.;
+    if (!_stopDensityFile.empty()) {
+      _stopSampler.fire(_randFlat, pos, time);
     }
+    else {
+      // 获取 SimParticleCollection
+      const auto simh = event.getValidHandle<SimParticleCollection>(_inputSimParticles);
+
+      // 获取停止μ子列表
+      const auto mus = stoppedMuMinusList(simh);
 
-    // 随机选择一个停止μ子
-    const auto mustop = mus.at(_eng.operator unsigned int() % mus.size());
+      if(mus.empty()) {
+        throw cet::exception("BADINPUT")
+          << "StoppedMuonXRayGammaRayGun::produce(): no suitable stopped muon in the input SimParticleCollection\n";
+      }
+
+      // 随机选择一个停止μ子
+      const auto mustop = mus.at(_genEng.operator unsigned int() % mus.size());
 
-    // 获取μ子停止位置和时间
-    const CLHEP::Hep3Vector pos = mustop->endPosition();
-    double time = mustop->endGlobalTime();
+      // 获取μ子停止位置和时间
+      pos = mustop->endPosition();
+      time = mustop->endGlobalTime();
+    }
     const double genRadius = sqrt((pos.x()+3904.0)*(pos.x()+3904.0)+pos.y()*pos.y());
 
     int nphotons = 0;
     vector<double> photonEnergy;
     vector<double> photonTime;
+    double weight = 1.;
 
     // create X Rays and Gamma Rays:
     double prob = _randFlat.fire();
@@ -174,11 +527,23 @@ namespace mu2e {
     }
     prob = _randFlat.fire();
     if (_do844 && prob < 0.040){  //
-      ++nphotons;
-      photonEnergy.push_back(0.844);
       //Note: This is a delayed gamma, need to add delay time
       double meanLifetime844 = 822.0*CLHEP::second; //822 second lifetime (same as 9.5min(570s) halflife)
-      photonTime.push_back(time + _randExp.fire(meanLifetime844));
+      if (_truncate844) {
+        double dt = 0.;
+        const double pin = sampleTruncatedDelay(time, meanLifetime844, dt);
+        if (pin > 0.) {
+          ++nphotons;
+          photonEnergy.push_back(0.844);
+          photonTime.push_back(time + dt);
+          weight = pin;
+        }
+      }
+      else {
+        ++nphotons;
+        photonEnergy.push_back(0.844);
+        photonTime.push_back(time + _randExp.fire(meanLifetime844));
+      }
     }
     prob = _randFlat.fire();
     if (_do1809 && prob < 0.300){  //
@@ -222,8 +587,31 @@ namespace mu2e {
     }
 
     event.put(std::move(output));
+    if (_truncate844) {
+      event.put(std::make_unique<EventWeight>(weight));
+    }
   }
 
+  //================================================================
+  double StoppedMuonXRayGammaRayGun::sampleTruncatedDelay(double t0, double meanLifetime, double& dt) {
+    // Delays that put the photon inside [_timeWindowMin, _timeWindowMax]
+    const double dtmin = std::max(0., _timeWindowMin - t0);
+    const double dtmax = _timeWindowMax - t0;
+    if (dtmax <= dtmin) {
+      return 0.;
+    }
+
+    // P(dtmin < dt < dtmax) = exp(-dtmin/tau) * (1 - exp(-(dtmax-dtmin)/tau)).
+    // expm1/log1p keep the precision for windows much shorter than tau.
+    const double span = -std::expm1(-(dtmax - dtmin)/meanLifetime);
+    const double pin = std::exp(-dtmin/meanLifetime) * span;
+
+    // Invert the CDF of the exponential truncated to the window
+    dt = dtmin - meanLifetime*std::log1p(-_randFlat.fire()*span);
+    return pin;
+  }
+
+  //================================================================
   void StoppedMuonXRayGammaRayGun::bookHistograms(){
 
     // Compute a binning that ensures that the stopping target foils are at bin centers.